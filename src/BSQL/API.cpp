@@ -1,7 +1,19 @@
 ﻿#include "BSQL.h"
 
+//Initialize and Shutdown must not race other calls, everything else may come from any thread
 std::unique_ptr<Library> library;
-std::string lastCreatedConnection, lastCreatedOperation, lastCreatedOperationConnectionId, lastRow, returnValueHolder;
+//byond copies the result before the calling thread can make another call, so one buffer per thread is enough
+thread_local std::string returnValueHolder;
+Profiler profiler;
+
+//defines the export around a body of the same signature, so every call can be timed
+#define BSQL_EXPORT(name) \
+	static const char* name##Body(const int argumentCount, const char* const* const args) noexcept; \
+	BYOND_FUNC name(const int argumentCount, const char* const* const args) noexcept { \
+		static auto& entry(profiler.Register(#name)); \
+		return profiler.Record(entry, name##Body, argumentCount, args); \
+	} \
+	static const char* name##Body(const int argumentCount, const char* const* const args) noexcept
 
 const char* TryLoadQuery(const int argumentCount, const char* const* const args, Query** query) noexcept {
 	if (argumentCount != 2)
@@ -13,7 +25,7 @@ const char* TryLoadQuery(const int argumentCount, const char* const* const args,
 		return "Invalid operation identifier!";
 
 	try {
-		auto connection(library->GetConnection(lastCreatedOperationConnectionId));
+		auto connection(library->GetConnection(connectionIdentifier));
 		if (!connection)
 			return "Connection identifier does not exist!";
 		auto operation(connection->GetOperation(operationIdentifier));
@@ -30,28 +42,41 @@ const char* TryLoadQuery(const int argumentCount, const char* const* const args,
 }
 
 extern "C" {
-	BYOND_FUNC Version(const int argumentCount, const char* const* const args) noexcept {
-		return "v1.3.0.0";
+	BSQL_EXPORT(Version) {
+		return "v2.0.0.0";
 	}
 
-	BYOND_FUNC Initialize(const int argumentCount, const char* const* const args) noexcept {
+	BSQL_EXPORT(Initialize) {
+		if (library) {
+			//still running after a soft shutdown
+			{
+				auto lock(library->Lock());
+				if (library->Unpark())
+					return nullptr;
+			}
+			//a round that never shut down, nothing can reach what it left behind
+			library.reset();
+		}
 		try {
 			library = std::make_unique<Library>();
 		}
 		catch (std::bad_alloc&) {
 			return "Out of memory!";
 		}
+		catch (std::system_error&) {
+			return "Unable to start dispatcher thread!";
+		}
 		return nullptr;
 	}
 
-	BYOND_FUNC Shutdown(const int argumentCount, const char* const* const args) noexcept {
-		if (library) {
-			if (!lastCreatedConnection.empty())
-				lastCreatedConnection = std::string();
-			if (!lastCreatedOperation.empty())
-				lastCreatedOperation = std::string();
-			library.reset();
+	BSQL_EXPORT(Shutdown) {
+		const auto soft(argumentCount == 1 && args[0] && args[0][0] == '1');
+		if (soft && library) {
+			auto lock(library->Lock());
+			library->Park();
 		}
+		else
+			library.reset();
 		return nullptr;
 	}
 
@@ -62,6 +87,7 @@ extern "C" {
 			return "Invalid connection identifier!";
 		if (!operationIdentifier)
 			return "Invalid operation identifier!";
+		auto lock(library->Lock());
 		try {
 			auto connection(library->GetConnection(connectionIdentifier));
 			if (!connection)
@@ -79,21 +105,21 @@ extern "C" {
 		}
 	}
 
-	BYOND_FUNC GetError(const int argumentCount, const char* const* const args) noexcept {
+	BSQL_EXPORT(GetError) {
 		if (argumentCount != 2)
 			return "Invalid arguments!";
 		const auto& connectionIdentifier(args[0]), operationIdentifier(args[1]);
 		return GetErrorImpl(connectionIdentifier, operationIdentifier, false);
 	}
 
-	BYOND_FUNC GetErrorCode(const int argumentCount, const char* const* const args) noexcept {
+	BSQL_EXPORT(GetErrorCode) {
 		if (argumentCount != 2)
 			return "Invalid arguments!";
 		const auto& connectionIdentifier(args[0]), operationIdentifier(args[1]);
 		return GetErrorImpl(connectionIdentifier, operationIdentifier, true);
 	}
 
-	BYOND_FUNC CreateConnection(const int argumentCount, const char* const* const args) noexcept {
+	BSQL_EXPORT(CreateConnection) {
 		if (argumentCount != 4)
 			return "Invalid arguments!";
 		if (!library)
@@ -112,8 +138,9 @@ extern "C" {
 			std::string conType(connectionType);
 			if (conType == "MySql")
 				type = Connection::Type::MySql;
+			else if (conType == "Sqlite")
+				type = Connection::Type::Sqlite;
 			else if (conType == "SqlServer")
-				//type = Connection::Type::SqlServer;
 				return "SqlServer is not supported in this release!";
 			else
 				return "Invalid connection type!";
@@ -133,27 +160,25 @@ extern "C" {
 		if (threadLimit <= 0)
 			return "threadLimit must be greater than zero!";
 
-		if (!lastCreatedConnection.empty())
-			//guess they didn't want it
-			library->ReleaseConnection(lastCreatedConnection);
-
+		auto lock(library->Lock());
 		auto result(library->CreateConnection(type, static_cast<unsigned int>(asyncTimeout), static_cast<unsigned int>(blockingTimeout), static_cast<unsigned int>(threadLimit)));
 		if (result.empty())
 			return "Out of memory";
 
-		lastCreatedConnection = std::move(result);
-		return nullptr;
-	}
-
-	BYOND_FUNC GetConnection(const int argumentCount, const char* const* const args) noexcept {
-		if (!library || lastCreatedConnection.empty())
-			return nullptr;
-		returnValueHolder = std::string();
-		std::swap(returnValueHolder, lastCreatedConnection);
+		try {
+			auto recorder(library->GetRecorder());
+			if (recorder)
+				recorder->RecordCreateConnection(result, connectionType, static_cast<unsigned int>(asyncTimeout), static_cast<unsigned int>(blockingTimeout), static_cast<unsigned int>(threadLimit));
+			returnValueHolder = std::move(result);
+		}
+		catch (std::bad_alloc&) {
+			library->ReleaseConnection(result);
+			return "Out of memory!";
+		}
 		return returnValueHolder.c_str();
 	}
 
-	BYOND_FUNC ReleaseConnection(const int argumentCount, const char* const* const args) noexcept {
+	BSQL_EXPORT(ReleaseConnection) {
 		if (argumentCount != 1)
 			return "Invalid arguments!";
 		const auto& connectionIdentifier(args[0]);
@@ -161,9 +186,13 @@ extern "C" {
 			return "Invalid connection identifier!";
 		if (!library)
 			return "Library not initialized!";
+		auto lock(library->Lock());
 		try {
 			if (!library->ReleaseConnection(connectionIdentifier))
 				return "Connection identifier does not exist!";
+			auto recorder(library->GetRecorder());
+			if (recorder)
+				recorder->RecordReleaseConnection(connectionIdentifier);
 		}
 		catch (std::bad_alloc&) {
 			return "Out of memory!";
@@ -171,15 +200,7 @@ extern "C" {
 		return nullptr;
 	}
 
-	BYOND_FUNC GetOperation(const int argumentCount, const char* const* const args) noexcept {
-		if (!library || lastCreatedOperation.empty())
-			return nullptr;
-		returnValueHolder = std::string();
-		std::swap(returnValueHolder, lastCreatedOperation);
-		return returnValueHolder.c_str();
-	}
-
-	BYOND_FUNC ReleaseOperation(const int argumentCount, const char* const* const args) noexcept {
+	BSQL_EXPORT(ReleaseOperation) {
 		if (argumentCount != 2)
 			return "Invalid arguments!";
 		const auto& connectionIdentifier(args[0]), operationIdentifier(args[1]);
@@ -189,12 +210,16 @@ extern "C" {
 			return "Invalid operation identifier!";
 		if (!library)
 			return "Library not initialized!";
+		auto lock(library->Lock());
 		try {
 			auto connection(library->GetConnection(connectionIdentifier));
 			if (!connection)
 				return "Connection identifier does not exist!";
 			if (!connection->ReleaseOperation(operationIdentifier))
 				return "Operation identifier does not exist!";
+			auto recorder(library->GetRecorder());
+			if (recorder)
+				recorder->RecordReleaseOperation(connectionIdentifier, operationIdentifier);
 			return nullptr;
 		}
 		catch (std::bad_alloc&) {
@@ -202,10 +227,11 @@ extern "C" {
 		}
 	}
 
-	BYOND_FUNC OpenConnection(const int argumentCount, const char* const* const args) noexcept {
-		if (argumentCount != 6)
+	BSQL_EXPORT(OpenConnection) {
+		if (argumentCount < 6 || argumentCount > 7)
 			return "Invalid arguments!";
 		const auto& connectionIdentifier(args[0]), ipaddress(args[1]), port(args[2]), username(args[3]), password(args[4]), database(args[5]);
+		const auto options(argumentCount == 7 ? args[6] : nullptr);
 
 		if (!connectionIdentifier)
 			return "Invalid connection identifier!";
@@ -234,23 +260,108 @@ extern "C" {
 
 		if (!library)
 			return "Library not initialized!";
+		auto lock(library->Lock());
 		try {
-			//clear the cache
-			GetOperation(0, nullptr);
-			lastCreatedOperationConnectionId = connectionIdentifier;
-			auto connection(library->GetConnection(lastCreatedOperationConnectionId));
+			auto connection(library->GetConnection(connectionIdentifier));
 			if (!connection)
 				return "Connection identifier does not exist!";
-			lastCreatedOperation = connection->Connect(ipaddress, realPort, username, password, database);
+			if (options) {
+				returnValueHolder = connection->Configure(Library::ParseParams(options));
+				if (!returnValueHolder.empty())
+					return returnValueHolder.c_str();
+			}
+			auto operation(connection->Connect(ipaddress, realPort, username, password, database));
+			if (operation.empty())
+				return "Connection is already open!";
+			auto recorder(library->GetRecorder());
+			if (recorder)
+				recorder->RecordOpenConnection(connectionIdentifier, operation, ipaddress, realPort, database ? database : "", options ? options : "");
+			returnValueHolder = std::move(operation);
+			return returnValueHolder.c_str();
+		}
+		catch (std::bad_alloc&) {
+			return "Out of memory!";
+		}
+	}
+
+	const char* ParsePriority(const char* const& priorityString, Connection::Priority& priority) noexcept {
+		if (!priorityString)
+			return "Invalid priority!";
+		try {
+			const auto parsed(std::stoi(priorityString));
+			if (parsed < 0 || parsed >= Connection::PriorityCount)
+				return "Invalid priority!";
+			priority = static_cast<Connection::Priority>(parsed);
 			return nullptr;
 		}
+		catch (std::invalid_argument&) {
+			return "Invalid priority!";
+		}
+		catch (std::out_of_range&) {
+			return "Invalid priority!";
+		}
+	}
+
+	const char* ParseQueryFlags(const char* const& flagsString, unsigned int& flags) noexcept {
+		if (!flagsString)
+			return "Invalid query flags!";
+		try {
+			const auto parsed(std::stoi(flagsString));
+			const auto both(Connection::StoreResult | Connection::UseResult);
+			if (parsed < 0 || (parsed & ~(both | Connection::Primary | Connection::Shared | Connection::Chunked | Connection::Deferrable)) != 0 || (parsed & both) == both)
+				return "Invalid query flags!";
+			flags = static_cast<unsigned int>(parsed);
+			return nullptr;
+		}
+		catch (std::invalid_argument&) {
+			return "Invalid query flags!";
+		}
+		catch (std::out_of_range&) {
+			return "Invalid query flags!";
+		}
+	}
+
+	//deciseconds, like DM's sleep()
+	const char* ParseInterval(const char* const& intervalString, std::chrono::steady_clock::duration& interval) noexcept {
+		if (!intervalString)
+			return "Invalid interval!";
+		try {
+			const auto parsed(std::stol(intervalString));
+			if (parsed <= 0)
+				return "Invalid interval!";
+			interval = std::chrono::milliseconds(parsed) * 100;
+			return nullptr;
+		}
+		catch (std::invalid_argument&) {
+			return "Invalid interval!";
+		}
+		catch (std::out_of_range&) {
+			return "Invalid interval!";
+		}
+	}
+
+	const char* NewQueryImpl(const char* const& connectionIdentifier, const char* const& queryText, const Connection::Priority priority, const unsigned int flags, std::unique_ptr<ExportFile>&& exportFile, const std::string& exportFormat) {
+		auto lock(library->Lock());
+		try {
+			auto connection(library->GetConnection(connectionIdentifier));
+			if (!connection)
+				return "Connection identifier does not exist!";
+			auto operation(connection->CreateQuery(queryText, priority, flags, std::move(exportFile), true));
+			if (operation.empty())
+				return "Error creating query! Is the connection complete?";
+			auto recorder(library->GetRecorder());
+			if (recorder)
+				recorder->RecordNewQuery(connectionIdentifier, operation, queryText, priority, flags, exportFormat);
+			returnValueHolder = std::move(operation);
+			return returnValueHolder.c_str();
+		}
 		catch (std::bad_alloc&) {
 			return "Out of memory!";
 		}
 	}
 
-	BYOND_FUNC NewQuery(const int argumentCount, const char* const* const args) noexcept {
-		if (argumentCount != 2)
+	BSQL_EXPORT(NewQuery) {
+		if (argumentCount < 2 || argumentCount > 4)
 			return "Invalid arguments!";
 		const auto& connectionIdentifier(args[0]), queryText(args[1]);
 		if (!connectionIdentifier)
@@ -259,30 +370,65 @@ extern "C" {
 			return "Invalid query text!";
 		if (!library)
 			return "Library not initialized!";
+		auto priority(Connection::Normal);
+		if (argumentCount >= 3) {
+			const auto error(ParsePriority(args[2], priority));
+			if (error)
+				return error;
+		}
+		auto flags(0U);
+		if (argumentCount == 4) {
+			const auto error(ParseQueryFlags(args[3], flags));
+			if (error)
+				return error;
+		}
+		return NewQueryImpl(connectionIdentifier, queryText, priority, flags, nullptr, std::string());
+	}
+
+	BSQL_EXPORT(NewExport) {
+		if (argumentCount < 4 || argumentCount > 6)
+			return "Invalid arguments!";
+		const auto& connectionIdentifier(args[0]), queryText(args[1]), path(args[2]), formatString(args[3]);
+		if (!connectionIdentifier)
+			return "Invalid connection identifier!";
+		if (!queryText)
+			return "Invalid query text!";
+		if (!path || !path[0])
+			return "Invalid export path!";
+		ExportFile::Format format;
+		if (!formatString || !ExportFile::ParseFormat(formatString, format))
+			return "Invalid export format!";
+		if (!library)
+			return "Library not initialized!";
+		auto priority(Connection::Normal);
+		if (argumentCount >= 5) {
+			const auto error(ParsePriority(args[4], priority));
+			if (error)
+				return error;
+		}
+		auto flags(0U);
+		if (argumentCount == 6) {
+			const auto error(ParseQueryFlags(args[5], flags));
+			if (error)
+				return error;
+		}
 		try {
-			//clear the cache
-			GetOperation(0, nullptr);
-			auto connection(library->GetConnection(lastCreatedOperationConnectionId));
-			if (!connection)
-				return "Connection identifier does not exist!";
-			lastCreatedOperation = connection->CreateQuery(queryText);
-			if (lastCreatedOperation.empty())
-				return "Error creating query! Is the connection complete?";
-			return nullptr;
+			return NewQueryImpl(connectionIdentifier, queryText, priority, flags, std::make_unique<ExportFile>(path, format), formatString);
 		}
 		catch (std::bad_alloc&) {
 			return "Out of memory!";
 		}
 	}
 
-	BYOND_FUNC OpComplete(const int argumentCount, const char* const* const args) noexcept {
+	BSQL_EXPORT(OpComplete) {
 		if (argumentCount != 2)
 			return nullptr;
 		const auto& connectionIdentifier(args[0]), operationIdentifier(args[1]);
-		if (!connectionIdentifier || !operationIdentifier)
+		if (!connectionIdentifier || !operationIdentifier || !library)
 			return nullptr;
+		auto lock(library->Lock());
 		try {
-			auto connection(library->GetConnection(lastCreatedOperationConnectionId));
+			auto connection(library->GetConnection(connectionIdentifier));
 			if (!connection)
 				return nullptr;
 			auto operation(connection->GetOperation(operationIdentifier));
@@ -295,25 +441,19 @@ extern "C" {
 		}
 	}
 
-	BYOND_FUNC GetRow(const int argumentCount, const char* const* const args) noexcept {
+	BSQL_EXPORT(ReadyRow) {
 		if (!library)
 			return "Library not initialized!";
-		if (lastRow.empty())
-			return nullptr;
-		returnValueHolder = std::string();
-		std::swap(returnValueHolder, lastRow);
-		return returnValueHolder.c_str();
-	}
-
-	BYOND_FUNC ReadyRow(const int argumentCount, const char* const* const args) noexcept {
+		auto lock(library->Lock());
 		Query* query;
 		auto res(TryLoadQuery(argumentCount, args, &query));
 		if (res != nullptr)
 			return res;
 		try {
 			if (query->IsComplete(false)) {
-				lastRow = query->CurrentRow();
-				return "DONE";
+				//rows are json objects so they can't be mistaken for anything else we return
+				returnValueHolder = query->CurrentRow();
+				return returnValueHolder.empty() ? "DONE" : returnValueHolder.c_str();
 			}
 		}
 		catch (std::bad_alloc&) {
@@ -322,15 +462,80 @@ extern "C" {
 		return "NOTDONE";
 	}
 
-	BYOND_FUNC QuoteString(const int argumentCount, const char* const* const args) noexcept {
+	BSQL_EXPORT(NextResultSet) {
+		if (!library)
+			return "Library not initialized!";
+		auto lock(library->Lock());
+		Query* query;
+		auto res(TryLoadQuery(argumentCount, args, &query));
+		if (res != nullptr)
+			return res;
+		return query->NextResultSet() ? "NEXTSET" : "DONE";
+	}
+
+	BSQL_EXPORT(GetQueryInfo) {
+		if (!library)
+			return "Library not initialized!";
+		auto lock(library->Lock());
+		Query* query;
+		auto res(TryLoadQuery(argumentCount, args, &query));
+		if (res != nullptr)
+			return res;
+		try {
+			returnValueHolder = query->Info();
+			return returnValueHolder.empty() ? "Operation is not complete!" : returnValueHolder.c_str();
+		}
+		catch (std::bad_alloc&) {
+			return "Out of memory!";
+		}
+	}
+
+	BSQL_EXPORT(ReadChunk) {
+		if (argumentCount < 4 || argumentCount > 5)
+			return "Invalid arguments!";
+		if (!library)
+			return "Library not initialized!";
+		const auto& blobString(args[2]), offsetString(args[3]);
+		if (!blobString || !offsetString)
+			return "Invalid arguments!";
+		auto lock(library->Lock());
+		Query* query;
+		auto res(TryLoadQuery(2, args, &query));
+		if (res != nullptr)
+			return res;
+		try {
+			size_t blob, offset, length(Query::ChunkLimit);
+			try {
+				blob = static_cast<size_t>(std::stoull(blobString));
+				offset = static_cast<size_t>(std::stoull(offsetString));
+				if (argumentCount > 4 && args[4])
+					length = static_cast<size_t>(std::stoull(args[4]));
+			}
+			catch (std::invalid_argument&) {
+				return "Invalid arguments!";
+			}
+			catch (std::out_of_range&) {
+				return "Invalid arguments!";
+			}
+			if (length == 0)
+				length = Query::ChunkLimit;
+			returnValueHolder = query->ReadChunk(blob, offset, length);
+			return returnValueHolder.empty() ? "Blob identifier does not exist!" : returnValueHolder.c_str();
+		}
+		catch (std::bad_alloc&) {
+			return "Out of memory!";
+		}
+	}
+
+	BSQL_EXPORT(QuoteString) {
 		if (argumentCount != 2)
 			return nullptr;
 		auto connectionIdentifier(args[0]), str(args[1]);
 		if (!connectionIdentifier || !str || !library)
 			return nullptr;
 
+		auto lock(library->Lock());
 		try {
-			//clear the cache
 			auto connection(library->GetConnection(connectionIdentifier));
 			if (!connection)
 				return nullptr;
@@ -345,7 +550,7 @@ extern "C" {
 		}
 	}
 
-	BYOND_FUNC BlockOnOperation(const int argumentCount, const char* const* const args) noexcept {
+	BSQL_EXPORT(BlockOnOperation) {
 		if (argumentCount != 2)
 			return "Invalid arguments!";
 		const auto& connectionIdentifier(args[0]), operationIdentifier(args[1]);
@@ -355,6 +560,7 @@ extern "C" {
 			return "Invalid operation identifier!";
 		if (!library)
 			return "Library not initialized!";
+		auto lock(library->Lock());
 		try {
 			auto connection(library->GetConnection(connectionIdentifier));
 			if (!connection)
@@ -362,15 +568,342 @@ extern "C" {
 			auto op(connection->GetOperation(operationIdentifier));
 			if (!op)
 				return "Operation identifier does not exist!";
+			const auto limit(connection->blockingTimeout * 1000);
 			auto I(0U);
-			for (; !op->IsComplete(false) && I < connection->blockingTimeout * 1000; ++I)
+			for (; !op->IsComplete(false) && I < limit; ++I) {
+				//let the dispatcher and other threads run while we wait, they may release the connection or the op in the meantime
+				lock.unlock();
 				std::this_thread::sleep_for(std::chrono::milliseconds(1));
-			if (I >= connection->blockingTimeout * 1000)
+				lock.lock();
+				connection = library->GetConnection(connectionIdentifier);
+				if (!connection)
+					return "Connection identifier does not exist!";
+				op = connection->GetOperation(operationIdentifier);
+				if (!op)
+					return "Operation identifier does not exist!";
+			}
+			if (I >= limit)
 				return "Operation timed out!";	//match this with the api, too lazy to do it any other way
-			if (op->IsQuery())
-				lastRow = static_cast<Query*>(op)->CurrentRow();
+			if (!op->IsQuery())
+				return nullptr;
+			returnValueHolder = static_cast<Query*>(op)->CurrentRow();
+			return returnValueHolder.empty() ? nullptr : returnValueHolder.c_str();
+		}
+		catch (std::bad_alloc&) {
+			return "Out of memory!";
+		}
+	}
+
+	BSQL_EXPORT(GetConnectionStats) {
+		if (argumentCount != 1)
+			return nullptr;
+		const auto& connectionIdentifier(args[0]);
+		if (!connectionIdentifier || !library)
+			return nullptr;
+		auto lock(library->Lock());
+		try {
+			auto connection(library->GetConnection(connectionIdentifier));
+			if (!connection)
+				return nullptr;
+			returnValueHolder = connection->GetStats();
+			return returnValueHolder.c_str();
+		}
+		catch (std::bad_alloc&) {
 			return nullptr;
 		}
+	}
+
+	BSQL_EXPORT(StartCapture) {
+		if (argumentCount != 1)
+			return "Invalid arguments!";
+		const auto& path(args[0]);
+		if (!path)
+			return "Invalid capture path!";
+		if (!library)
+			return "Library not initialized!";
+		auto lock(library->Lock());
+		try {
+			if (!library->StartCapture(path))
+				return "Unable to open capture file!";
+		}
+		catch (std::bad_alloc&) {
+			return "Out of memory!";
+		}
+		return nullptr;
+	}
+
+	BSQL_EXPORT(StopCapture) {
+		if (!library)
+			return "Library not initialized!";
+		auto lock(library->Lock());
+		library->StopCapture();
+		return nullptr;
+	}
+
+	BSQL_EXPORT(NewSchedule) {
+		if (argumentCount < 3 || argumentCount > 5)
+			return "Invalid arguments!";
+		const auto& connectionIdentifier(args[0]), queryText(args[1]), intervalString(args[2]);
+		if (!connectionIdentifier)
+			return "Invalid connection identifier!";
+		if (!queryText)
+			return "Invalid query text!";
+		if (!library)
+			return "Library not initialized!";
+		std::chrono::steady_clock::duration interval;
+		{
+			const auto error(ParseInterval(intervalString, interval));
+			if (error)
+				return error;
+		}
+		auto priority(Connection::Bulk);
+		if (argumentCount >= 4) {
+			const auto error(ParsePriority(args[3], priority));
+			if (error)
+				return error;
+		}
+		auto flags(0U);
+		if (argumentCount == 5) {
+			const auto error(ParseQueryFlags(args[4], flags));
+			if (error)
+				return error;
+		}
+		auto lock(library->Lock());
+		try {
+			if (!library->GetConnection(connectionIdentifier))
+				return "Connection identifier does not exist!";
+			returnValueHolder = library->AddSchedule(std::make_unique<Schedule>(connectionIdentifier, queryText, interval, priority, flags));
+			if (returnValueHolder.empty())
+				return "Out of memory!";
+			return returnValueHolder.c_str();
+		}
+		catch (std::bad_alloc&) {
+			return "Out of memory!";
+		}
+	}
+
+	BSQL_EXPORT(GetSchedule) {
+		if (argumentCount != 1)
+			return "Invalid arguments!";
+		const auto& scheduleIdentifier(args[0]);
+		if (!scheduleIdentifier)
+			return "Invalid schedule identifier!";
+		if (!library)
+			return "Library not initialized!";
+		auto lock(library->Lock());
+		try {
+			const auto schedule(library->GetSchedule(scheduleIdentifier));
+			if (!schedule)
+				return "Schedule identifier does not exist!";
+			returnValueHolder = schedule->GetStats();
+			return returnValueHolder.c_str();
+		}
+		catch (std::bad_alloc&) {
+			return "Out of memory!";
+		}
+	}
+
+	BSQL_EXPORT(ReleaseSchedule) {
+		if (argumentCount != 1)
+			return "Invalid arguments!";
+		const auto& scheduleIdentifier(args[0]);
+		if (!scheduleIdentifier)
+			return "Invalid schedule identifier!";
+		if (!library)
+			return "Library not initialized!";
+		auto lock(library->Lock());
+		try {
+			if (!library->ReleaseSchedule(scheduleIdentifier))
+				return "Schedule identifier does not exist!";
+		}
+		catch (std::bad_alloc&) {
+			return "Out of memory!";
+		}
+		return nullptr;
+	}
+
+	BSQL_EXPORT(NewFeed) {
+		if (argumentCount < 4 || argumentCount > 6)
+			return "Invalid arguments!";
+		const auto& connectionIdentifier(args[0]), table(args[1]), keyColumn(args[2]), intervalString(args[3]);
+		if (!connectionIdentifier)
+			return "Invalid connection identifier!";
+		if (!table || !table[0])
+			return "Invalid table!";
+		if (!keyColumn || !keyColumn[0])
+			return "Invalid key column!";
+		if (!library)
+			return "Library not initialized!";
+		std::chrono::steady_clock::duration interval;
+		{
+			const auto error(ParseInterval(intervalString, interval));
+			if (error)
+				return error;
+		}
+		//a string so DM's floats don't round it
+		auto cursor(0ULL);
+		if (argumentCount >= 5) {
+			if (!args[4])
+				return "Invalid cursor!";
+			if (args[4][0]) {
+				try {
+					if (args[4][0] == '-')
+						return "Invalid cursor!";
+					cursor = std::stoull(args[4]);
+				}
+				catch (std::invalid_argument&) {
+					return "Invalid cursor!";
+				}
+				catch (std::out_of_range&) {
+					return "Invalid cursor!";
+				}
+			}
+		}
+		auto batch(Feed::DefaultBatch);
+		if (argumentCount == 6) {
+			if (!args[5])
+				return "Invalid batch size!";
+			try {
+				const auto parsed(std::stol(args[5]));
+				if (parsed <= 0 || parsed > static_cast<long>(Feed::MaxBatch))
+					return "Invalid batch size!";
+				batch = static_cast<unsigned int>(parsed);
+			}
+			catch (std::invalid_argument&) {
+				return "Invalid batch size!";
+			}
+			catch (std::out_of_range&) {
+				return "Invalid batch size!";
+			}
+		}
+		auto lock(library->Lock());
+		try {
+			if (!library->GetConnection(connectionIdentifier))
+				return "Connection identifier does not exist!";
+			returnValueHolder = library->AddSchedule(std::make_unique<Feed>(connectionIdentifier, table, keyColumn, cursor, interval, batch));
+			if (returnValueHolder.empty())
+				return "Out of memory!";
+			return returnValueHolder.c_str();
+		}
+		catch (std::bad_alloc&) {
+			return "Out of memory!";
+		}
+	}
+
+	BSQL_EXPORT(ReadFeed) {
+		if (argumentCount != 1)
+			return "Invalid arguments!";
+		const auto& feedIdentifier(args[0]);
+		if (!feedIdentifier)
+			return "Invalid feed identifier!";
+		if (!library)
+			return "Library not initialized!";
+		auto lock(library->Lock());
+		try {
+			const auto schedule(library->GetSchedule(feedIdentifier));
+			if (!schedule)
+				return "Schedule identifier does not exist!";
+			if (!schedule->IsFeed())
+				return "Schedule is not a feed!";
+			returnValueHolder = static_cast<Feed*>(schedule)->Read();
+			return returnValueHolder.c_str();
+		}
+		catch (std::bad_alloc&) {
+			return "Out of memory!";
+		}
+	}
+
+	BSQL_EXPORT(StartProfiling) {
+		try {
+			profiler.Start();
+		}
+		catch (std::system_error&) {
+			return "Unable to start profiling!";
+		}
+		return nullptr;
+	}
+
+	BSQL_EXPORT(StopProfiling) {
+		profiler.Stop();
+		return nullptr;
+	}
+
+	BSQL_EXPORT(GetProfile) {
+		const auto reset(argumentCount == 1 && args[0] && args[0][0] == '1');
+		try {
+			returnValueHolder = profiler.GetStats(reset);
+			return returnValueHolder.c_str();
+		}
+		catch (std::bad_alloc&) {
+			return "Out of memory!";
+		}
+		catch (std::system_error&) {
+			return "Unable to read profile!";
+		}
+	}
+
+	BSQL_EXPORT(StartDigests) {
+		if (argumentCount > 1)
+			return "Invalid arguments!";
+		//milliseconds, a statement at least this slow gets explained once. 0 explains nothing
+		auto slowThreshold(0L);
+		if (argumentCount == 1) {
+			if (!args[0])
+				return "Invalid threshold!";
+			try {
+				slowThreshold = std::stol(args[0]);
+				if (slowThreshold < 0)
+					return "Invalid threshold!";
+			}
+			catch (std::invalid_argument&) {
+				return "Invalid threshold!";
+			}
+			catch (std::out_of_range&) {
+				return "Invalid threshold!";
+			}
+		}
+		if (!library)
+			return "Library not initialized!";
+		auto lock(library->Lock());
+		library->GetDigests().Start(std::chrono::milliseconds(slowThreshold));
+		return nullptr;
+	}
+
+	BSQL_EXPORT(StopDigests) {
+		if (!library)
+			return "Library not initialized!";
+		auto lock(library->Lock());
+		library->GetDigests().Stop();
+		return nullptr;
+	}
+
+	BSQL_EXPORT(GetDigests) {
+		if (argumentCount > 1)
+			return "Invalid arguments!";
+		auto count(0UL);
+		if (argumentCount == 1) {
+			if (!args[0])
+				return "Invalid count!";
+			try {
+				const auto parsed(std::stol(args[0]));
+				if (parsed < 0)
+					return "Invalid count!";
+				count = static_cast<unsigned long>(parsed);
+			}
+			catch (std::invalid_argument&) {
+				return "Invalid count!";
+			}
+			catch (std::out_of_range&) {
+				return "Invalid count!";
+			}
+		}
+		if (!library)
+			return "Library not initialized!";
+		auto lock(library->Lock());
+		try {
+			returnValueHolder = library->GetDigests().GetStats(count);
+			return returnValueHolder.c_str();
+		}
 		catch (std::bad_alloc&) {
 			return "Out of memory!";
 		}
@@ -6,10 +6,18 @@
 #endif
 
 #include <mysql/mysql.h>
+#include <sqlite3.h>
 
+#include <algorithm>
 #include <atomic>
+#include <cctype>
 #include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <deque>
+#include <fstream>
 #include <limits>
 #include <map>
 #include <memory>
@@ -17,10 +25,19 @@
 #include <queue>
 #include <stack>
 #include <string>
+#include <system_error>
 #include <thread>
+#include <unordered_set>
+#include <vector>
 
 class Library;
+class Connection;
 
+#include "RowQueue.h"
+#include "Dispatcher.h"
+#include "ExportFile.h"
+#include "Spool.h"
+#include "ConcurrencyLimit.h"
 #include "Operation.h"
 #include "Query.h"
 #include "Connection.h"
@@ -29,4 +46,13 @@ class Library;
 #include "MySqlConnectOperation.h"
 #include "MySqlQueryOperation.h"
 
+#include "SqliteConnection.h"
+#include "SqliteConnectOperation.h"
+#include "SqliteQueryOperation.h"
+
+#include "Schedule.h"
+#include "Feed.h"
+#include "QueryDigests.h"
+#include "TrafficRecorder.h"
+#include "Profiler.h"
 #include "Library.h"
@@ -0,0 +1,50 @@
+#include "BSQL.h"
+
+ConcurrencyLimit::ConcurrencyLimit(const unsigned int fixed) :
+	limit(fixed),
+	minimum(fixed),
+	maximum(fixed),
+	adaptive(false),
+	averageMs(0),
+	samples(0)
+{}
+
+void ConcurrencyLimit::MakeAdaptive(const unsigned int newMinimum, const unsigned int newMaximum) {
+	minimum = newMinimum;
+	maximum = newMaximum;
+	adaptive = true;
+	limit = std::min<double>(std::max<double>(limit, minimum), maximum);
+}
+
+unsigned int ConcurrencyLimit::Current() const {
+	return static_cast<unsigned int>(limit);
+}
+
+void ConcurrencyLimit::Sample(const std::chrono::steady_clock::duration elapsed, const unsigned int inFlight, const bool overloaded) {
+	//the average has to settle before it can call anything slow
+	const auto warmup(10ULL);
+	const auto smoothing(0.05);
+	const auto tolerance(2.0);
+	const auto backoff(0.9);
+
+	if (!adaptive)
+		return;
+
+	const auto ms(std::chrono::duration<double, std::milli>(elapsed).count());
+	const auto slow(samples >= warmup && ms > averageMs * tolerance);
+	averageMs = samples++ == 0 ? ms : averageMs + (ms - averageMs) * smoothing;
+
+	if (overloaded || slow)
+		limit = std::max<double>(limit * backoff, minimum);
+	//growing while most of it sits unused tells us nothing. One a round trip, not one a query, or it doubles every round trip
+	else if (inFlight * 2 >= limit)
+		limit = std::min<double>(limit + 1 / limit, maximum);
+}
+
+std::string ConcurrencyLimit::GetStats() const {
+	return "{\"limit\":" + std::to_string(Current())
+		+ ",\"min\":" + std::to_string(minimum)
+		+ ",\"max\":" + std::to_string(maximum)
+		+ ",\"adaptive\":" + (adaptive ? "1" : "0")
+		+ ",\"averageMs\":" + std::to_string(static_cast<unsigned long long>(averageMs)) + "}";
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+//How many workers a connection may run at once. Fixed unless given bounds, then it's AIMD: each finished query that had the room to use grows it by 1/limit, so by one per limit's worth of them, one that took far longer than usual or hit an overload error cuts it by a tenth. The dispatcher samples it too, through Query::IsComplete, so only touch it with the library lock held
+class ConcurrencyLimit {
+private:
+	double limit;
+	unsigned int minimum, maximum;
+	bool adaptive;
+	//long running average of how long a query takes, what a slow one is measured against
+	double averageMs;
+	unsigned long long samples;
+public:
+	ConcurrencyLimit(const unsigned int fixed);
+
+	//starts from the current limit pulled into the bounds
+	void MakeAdaptive(const unsigned int newMinimum, const unsigned int newMaximum);
+	unsigned int Current() const;
+	//a query that ran on its own worker finished, inFlight counts it
+	void Sample(const std::chrono::steady_clock::duration elapsed, const unsigned int inFlight, const bool overloaded);
+
+	//{"limit":N,"min":N,"max":N,"adaptive":0|1,"averageMs":N}
+	std::string GetStats() const;
+};
\ No newline at end of file
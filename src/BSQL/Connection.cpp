@@ -1,10 +1,17 @@
 #include "BSQL.h"
 
-Connection::Connection(Type type, Library& library, const unsigned int blockingTimeout) :
+Connection::Connection(Type type, Library& library, const unsigned int blockingTimeout, const unsigned int threadLimit) :
 	blockingTimeout(blockingTimeout),
 	library(library),
 	type(type),
-	identifierCounter(0)
+	threadLimit(threadLimit),
+	queueLimits(),
+	operationTtl(0),
+	identifierCounter(0),
+	queueStats(),
+	startingPending(false),
+	reclaimStats(),
+	nextReclaim(std::chrono::steady_clock::time_point::min())
 {}
 
 std::string Connection::AddOp(std::unique_ptr<Operation>&& operation) {
@@ -13,19 +20,267 @@ std::string Connection::AddOp(std::unique_ptr<Operation>&& operation) {
 	return identifier;
 }
 
-bool Connection::ReleaseOperation(const std::string& identifier) {
-	auto op(GetOperation(identifier));
-	if (!op)
+bool Connection::ParseSize(const std::string& value, unsigned long& output) {
+	if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+		return false;
+	try {
+		output = std::stoul(value);
+		return true;
+	}
+	catch (std::out_of_range&) {
+		return false;
+	}
+}
+
+bool Connection::ParseCommonOption(const std::string& key, const std::string& value, QueueLimits& limits, unsigned long& ttl, bool& valid) {
+	if (key == "operation_ttl")
+		valid = ParseSize(value, ttl);
+	else if (key == "max_pending")
+		valid = ParseSize(value, limits.total);
+	else if (key == "max_pending_interactive")
+		valid = ParseSize(value, limits.perPriority[Interactive]);
+	else if (key == "max_pending_normal")
+		valid = ParseSize(value, limits.perPriority[Normal]);
+	else if (key == "max_pending_bulk")
+		valid = ParseSize(value, limits.perPriority[Bulk]);
+	else
 		return false;
+	return true;
+}
+
+std::string Connection::AdmitQuery(std::unique_ptr<Query>&& query, const std::string& queryText, const Priority priority, const bool reclaimable) {
+	if (library.GetDigests().Enabled())
+		query->TrackDigest(queryText);
+	if (reclaimable)
+		query->SetReclaimable();
+	const auto limit(queueLimits.perPriority[priority]);
+	auto overloaded(limit != 0 && pendingQueries[priority].size() >= limit);
+	if (!overloaded && queueLimits.total != 0) {
+		auto total(0UL);
+		for (const auto& I : pendingQueries)
+			total += static_cast<unsigned long>(I.size());
+		overloaded = total >= queueLimits.total;
+	}
+	if (!overloaded)
+		return AddQuery(std::move(query), priority);
+	//fails straight away rather than adding to a backlog the server can't get through
+	++queueStats[priority].shed;
+	query->Reject("Connection overloaded!", OverloadedErrno);
+	return AddOp(std::move(query));
+}
+
+std::string Connection::AddQuery(std::unique_ptr<Query>&& query, const Priority priority) {
+	auto& queue(pendingQueries[priority]);
+	queue.emplace_back(PendingQuery{ query.get(), std::chrono::steady_clock::now() });
+	std::string identifier;
+	try {
+		identifier = AddOp(std::move(query));
+	}
+	catch (std::bad_alloc&) {
+		queue.pop_back();
+		throw;
+	}
+	StartPending();
+	return identifier;
+}
+
+void Connection::Requeue(Query& query, const Priority priority) {
+	pendingQueries[priority].emplace_back(PendingQuery{ &query, std::chrono::steady_clock::now() });
+	StartPending();
+}
+
+void Connection::ClearPending() {
+	for (auto& I : pendingQueries)
+		I.clear();
+}
+
+bool Connection::StartNext() {
+	//starting a query can return a connection to the pool which lands us back here
+	if (startingPending)
+		return false;
+
+	//each step a queue falls behind the one above it costs this much waiting, so bulk work can't starve
+	const auto agingStep(std::chrono::seconds(1));
+
+	const auto now(std::chrono::steady_clock::now());
+	auto best(-1);
+	long long bestRank(0);
+	for (auto I(0); I < PriorityCount; ++I) {
+		auto& queue(pendingQueries[I]);
+		if (queue.empty())
+			continue;
+		const auto rank(I - (now - queue.front().queued) / agingStep);
+		if (best < 0 || rank < bestRank) {
+			best = I;
+			bestRank = rank;
+		}
+	}
+	if (best < 0)
+		return false;
+
+	auto& queue(pendingQueries[best]);
+	startingPending = true;
+	bool started;
+	try {
+		started = queue.front().query->TryStart();
+	}
+	catch (...) {
+		startingPending = false;
+		throw;
+	}
+	startingPending = false;
+	if (!started)
+		return false;
+
+	const auto waited(std::chrono::steady_clock::now() - queue.front().queued);
+	auto& stats(queueStats[best]);
+	++stats.started;
+	stats.totalWait += waited;
+	stats.maxWait = std::max(stats.maxWait, waited);
+	queue.pop_front();
+	return true;
+}
+
+void Connection::StartPending() {
+	while (StartNext());
+}
+
+bool Connection::HasPending() const {
+	for (auto& I : pendingQueries)
+		if (!I.empty())
+			return true;
+	return false;
+}
+
+std::string Connection::GetStats() const {
+	static const char* const names[PriorityCount] = { "interactive", "normal", "bulk" };
+	std::string json("{");
+	for (auto I(0); I < PriorityCount; ++I) {
+		const auto& stats(queueStats[I]);
+		if (I > 0)
+			json.append(",");
+		json.append("\"");
+		json.append(names[I]);
+		json.append("\":{\"pending\":");
+		json.append(std::to_string(pendingQueries[I].size()));
+		json.append(",\"started\":");
+		json.append(std::to_string(stats.started));
+		json.append(",\"shed\":");
+		json.append(std::to_string(stats.shed));
+		json.append(",\"totalWaitMs\":");
+		json.append(std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(stats.totalWait).count()));
+		json.append(",\"maxWaitMs\":");
+		json.append(std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(stats.maxWait).count()));
+		json.append("}");
+	}
+	json.append(",\"reclaimed\":{\"operations\":");
+	json.append(std::to_string(reclaimStats.operations));
+	json.append(",\"bytes\":");
+	json.append(std::to_string(reclaimStats.bytes));
+	json.append("}");
+	if (spool) {
+		json.append(",\"spool\":");
+		json.append(spool->GetStats());
+	}
+	json.append(",\"concurrency\":");
+	json.append(threadLimit.GetStats());
+	json.append("}");
+	return json;
+}
+
+void Connection::Park() {}
+
+std::string Connection::Configure(const std::map<std::string, std::string>& options) {
+	auto limits(queueLimits);
+	auto ttl(operationTtl);
+	for (const auto& I : options) {
+		bool valid;
+		if (!ParseCommonOption(I.first, I.second, limits, ttl, valid))
+			return "Unknown connection option: " + I.first + "!";
+		if (!valid)
+			return "Invalid value for connection option " + I.first + "!";
+	}
+	queueLimits = limits;
+	operationTtl = ttl;
+	return std::string();
+}
+
+bool Connection::ReleaseOperation(const std::string& identifier) {
+	auto iter(operations.find(identifier));
+	if (iter == operations.end()) {
+		//DM letting go of one we already did
+		return reclaimedLookup.erase(identifier) != 0;
+	}
+	auto op(std::move(iter->second));
+	operations.erase(iter);
+
+	if (op->IsQuery()) {
+		const auto query(static_cast<Query*>(op.get()));
+		for (auto& queue : pendingQueries) {
+			const auto pending(std::find_if(queue.begin(), queue.end(), [query](const PendingQuery& I) { return I.query == query; }));
+			if (pending != queue.end()) {
+				queue.erase(pending);
+				break;
+			}
+		}
+	}
+
 	auto thread(op->GetActiveThread());
 	if (thread)
-		library.RegisterZombieThread(std::move(*thread));
-	return operations.erase(identifier) > 0;
+		library.RegisterZombieThread(std::move(*thread), op->WorkerExited());
+	//destroy it outside the map, it may hand resources back and start other operations
+	op.reset();
+	return true;
 }
 
 Operation* Connection::GetOperation(const std::string& identifier) {
 	auto res(operations.find(identifier));
 	if (res == operations.end())
 		return nullptr;
+	res->second->Touch();
 	return res->second.get();
 }
+
+std::chrono::steady_clock::time_point Connection::ReclaimIdle(const std::chrono::steady_clock::time_point now) {
+	if (operationTtl == 0)
+		return std::chrono::steady_clock::time_point::max();
+	if (now < nextReclaim)
+		return nextReclaim;
+	const auto ttl(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(operationTtl)));
+	//nothing goes more than a quarter of the ttl past its time
+	nextReclaim = now + ttl / 4;
+
+	std::vector<std::string> expired;
+	//from when it finished as well, one that ran longer than the ttl hasn't been seen by DM yet
+	for (const auto& I : operations)
+		if (I.second->IsQuery() && static_cast<const Query&>(*I.second).Reclaimable() && now - static_cast<const Query&>(*I.second).IdleSince() >= ttl)
+			expired.emplace_back(I.first);
+	for (auto& I : expired) {
+		const auto iter(operations.find(I));
+		if (iter == operations.end())
+			continue;
+		const auto bytes(static_cast<Query*>(iter->second.get())->BufferedBytes());
+		if (reclaimedIdentifiers.size() >= MaxReclaimedIdentifiers) {
+			reclaimedLookup.erase(reclaimedIdentifiers.front());
+			reclaimedIdentifiers.pop_front();
+		}
+		reclaimedIdentifiers.emplace_back(I);
+		reclaimedLookup.emplace(I);
+		ReleaseOperation(I);
+		++reclaimStats.operations;
+		reclaimStats.bytes += bytes;
+	}
+	return nextReclaim;
+}
+
+std::chrono::steady_clock::time_point Connection::ReplaySpool(const std::chrono::steady_clock::time_point now) {
+	return std::chrono::steady_clock::time_point::max();
+}
+
+std::string Connection::Explain(const std::string& queryText) {
+	return std::string();
+}
+
+void Connection::RecordDigest(std::string&& queryText, const std::chrono::steady_clock::duration elapsed, const unsigned long long rows, const bool failed) {
+	library.GetDigests().Record(*this, std::move(queryText), elapsed, rows, failed);
+}
\ No newline at end of file
@@ -4,7 +4,51 @@ class Connection {
 public:
 	enum Type {
 		MySql,
-		SqlServer
+		Sqlite
+	};
+	//NewQuery flags
+	enum QueryFlags {
+		//buffer the whole result client side so the server can let go of it right away
+		StoreResult = 1,
+		//stream rows as DM reads them, overrides a connection that stores by default
+		UseResult = 2,
+		//never send it to a read replica
+		Primary = 4,
+		//join an identical plain read that is already running instead of sending another one
+		Shared = 8,
+		//values over Query::ChunkThreshold come back as handles to be read a piece at a time
+		Chunked = 16,
+		//a write that may wait in the spool, if there is one, when the server can't be reached
+		Deferrable = 32
+	};
+	//order of the queues, lower goes first
+	enum Priority {
+		Interactive,
+		Normal,
+		Bulk,
+		PriorityCount
+	};
+	//the error code of a query turned away by the queue limits
+	static constexpr int OverloadedErrno = -3;
+	//reclaimed identifiers remembered so DM can still release them
+	static constexpr size_t MaxReclaimedIdentifiers = 10000;
+private:
+	struct PendingQuery {
+		Query* query;
+		std::chrono::steady_clock::time_point queued;
+	};
+	struct QueueStats {
+		unsigned long long started, shed;
+		std::chrono::steady_clock::duration totalWait, maxWait;
+	};
+	struct ReclaimStats {
+		unsigned long long operations, bytes;
+	};
+protected:
+	//most queries that may wait to start, 0 for no limit
+	struct QueueLimits {
+		unsigned long total;
+		unsigned long perPriority[PriorityCount];
 	};
 public:
 	const unsigned int blockingTimeout;
@@ -12,21 +56,66 @@ public:
 protected:
 	Library & library;
 	std::map<std::string, std::unique_ptr<Operation>> operations;
+	ConcurrencyLimit threadLimit;
+	QueueLimits queueLimits;
+	//seconds a finished query from DM may go untouched before it's released for it, 0 keeps them until DM does it
+	unsigned long operationTtl;
+	//null unless the connection was configured with one
+	std::unique_ptr<Spool> spool;
 private:
 	unsigned long long identifierCounter;
+	std::deque<PendingQuery> pendingQueries[PriorityCount];
+	QueueStats queueStats[PriorityCount];
+	bool startingPending;
+	ReclaimStats reclaimStats;
+	std::chrono::steady_clock::time_point nextReclaim;
+	//oldest first, for which to forget when there are too many. Ones DM has let go of since stay in until then
+	std::deque<std::string> reclaimedIdentifiers;
+	//what's looked up, every entry is also in reclaimedIdentifiers
+	std::unordered_set<std::string> reclaimedLookup;
 protected:
-	Connection(Type type, Library& library, const unsigned int blockingTimeout);
+	Connection(Type type, Library& library, const unsigned int blockingTimeout, const unsigned int threadLimit);
+
+	static bool ParseSize(const std::string& value, unsigned long& output);
+	//options every type of connection takes, false if the key isn't one, otherwise valid says if the value was any good
+	static bool ParseCommonOption(const std::string& key, const std::string& value, QueueLimits& limits, unsigned long& ttl, bool& valid);
 
 	std::string AddOp(std::unique_ptr<Operation>&& operation);
+	std::string AddQuery(std::unique_ptr<Query>&& query, const Priority priority);
+	//AddQuery for queries from DM and its schedules, which are subject to the queue limits and go in the digests
+	std::string AdmitQuery(std::unique_ptr<Query>&& query, const std::string& queryText, const Priority priority, const bool reclaimable);
+	void ClearPending();
 public:
 	virtual ~Connection() = default;
 
+	//a soft shutdown is about to destroy us, hand anything worth keeping for the next round to the library
+	virtual void Park();
+
 	Operation* GetOperation(const std::string& identifier);
 	virtual bool ReleaseOperation(const std::string& identifier);
 
+	//back of its queue for a query that gave up its worker and has to run again
+	void Requeue(Query& query, const Priority priority);
+	//start the best waiting query if there's room for it
+	bool StartNext();
+	void StartPending();
+	bool HasPending() const;
+	std::string GetStats() const;
+	//releases finished queries DM hasn't looked at within operationTtl, returns when it wants to be called again
+	std::chrono::steady_clock::time_point ReclaimIdle(const std::chrono::steady_clock::time_point now);
+	//sends along what the spool is holding once the server is back, returns when it wants to be called again
+	virtual std::chrono::steady_clock::time_point ReplaySpool(const std::chrono::steady_clock::time_point now);
+
+	//applies the options given to OpenConnection before connecting, returns an error message on failure
+	virtual std::string Configure(const std::map<std::string, std::string>& options);
 	virtual std::string Connect(const std::string& address, const unsigned short port, const std::string& username, const std::string& password, const std::string& database) = 0;
 
-	virtual std::string CreateQuery(const std::string& queryText) = 0;
+	//exportFile may be null, otherwise the rows are written there and DM only gets its summary. Only queries DM releases itself are reclaimable, see ReclaimIdle
+	virtual std::string CreateQuery(const std::string& queryText, const Priority priority, const unsigned int flags, std::unique_ptr<ExportFile>&& exportFile, const bool reclaimable) = 0;
 
 	virtual std::string Quote(const std::string& str) = 0;
+
+	//a bulk query for the plan of the given one, empty if there's no way to get it
+	virtual std::string Explain(const std::string& queryText);
+	void RecordDigest(std::string&& queryText, const std::chrono::steady_clock::duration elapsed, const unsigned long long rows, const bool failed);
 };
\ No newline at end of file
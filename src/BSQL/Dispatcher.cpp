@@ -0,0 +1,56 @@
+#include "BSQL.h"
+
+Dispatcher::Dispatcher(Library& library) :
+	library(library),
+	woken(false),
+	stopping(false),
+	dispatchThread(&Dispatcher::Run, this)
+{}
+
+Dispatcher::~Dispatcher() {
+	Stop();
+}
+
+void Dispatcher::Run() {
+	//anything that frees a slot wakes us, this only catches what slips through
+	const auto retryInterval(std::chrono::milliseconds(100));
+	auto pending(false);
+	//when a schedule, an idle sweep or a spool replay is next due
+	auto due(std::chrono::steady_clock::time_point::max());
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(wakeLock);
+			const auto ready([this]() { return woken || stopping; });
+			auto until(due);
+			if (pending)
+				until = std::min(until, std::chrono::steady_clock::now() + retryInterval);
+			if (until == std::chrono::steady_clock::time_point::max())
+				wakeCondition.wait(lock, ready);
+			else
+				wakeCondition.wait_until(lock, until, ready);
+			if (stopping)
+				return;
+			woken = false;
+		}
+		due = std::min(library.RunSchedules(), library.RunMaintenance());
+		pending = library.DispatchPending();
+	}
+}
+
+void Dispatcher::Wake() noexcept {
+	{
+		std::lock_guard<std::mutex> lock(wakeLock);
+		woken = true;
+	}
+	wakeCondition.notify_one();
+}
+
+void Dispatcher::Stop() noexcept {
+	{
+		std::lock_guard<std::mutex> lock(wakeLock);
+		stopping = true;
+	}
+	wakeCondition.notify_one();
+	if (dispatchThread.joinable())
+		dispatchThread.join();
+}
\ No newline at end of file
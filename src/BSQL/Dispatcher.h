@@ -0,0 +1,22 @@
+#pragma once
+
+//starts queued operations in the background as soon as workers finish, instead of waiting for the game to poll them, runs the schedules when they're due and lets go of operations DM forgot about
+class Dispatcher {
+private:
+	Library& library;
+	std::mutex wakeLock;
+	std::condition_variable wakeCondition;
+	bool woken, stopping;
+	std::thread dispatchThread;
+private:
+	void Run();
+public:
+	Dispatcher(Library& library);
+	Dispatcher(const Dispatcher&) = delete;
+	Dispatcher(Dispatcher&&) = delete;
+	~Dispatcher();
+
+	//safe from any thread
+	void Wake() noexcept;
+	void Stop() noexcept;
+};
\ No newline at end of file
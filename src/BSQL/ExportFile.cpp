@@ -0,0 +1,122 @@
+#include "BSQL.h"
+
+ExportFile::ExportFile(const std::string& path, const Format format) :
+	path(path),
+	format(format),
+	rows(0),
+	bytes(0),
+	failed(false)
+{}
+
+bool ExportFile::ParseFormat(const std::string& name, Format& format) {
+	if (name == "ndjson")
+		format = Ndjson;
+	else if (name == "csv")
+		format = Csv;
+	else
+		return false;
+	return true;
+}
+
+bool ExportFile::Flush() {
+	if (buffer.empty())
+		return true;
+	output.write(buffer.c_str(), buffer.length());
+	if (!output.good()) {
+		failed = true;
+		return false;
+	}
+	bytes += buffer.length();
+	buffer.clear();
+	return true;
+}
+
+void ExportFile::AppendCsvField(const char* const value, const size_t length) {
+	//RFC 4180, an empty quoted field keeps empty strings apart from NULL
+	if (length > 0 && std::find_if(value, value + length, [](const char c) { return c == ',' || c == '"' || c == '\r' || c == '\n'; }) == value + length) {
+		buffer.append(value, length);
+		return;
+	}
+	buffer.append("\"");
+	for (auto I(value); I < value + length; ++I) {
+		if (*I == '"')
+			buffer.append("\"");
+		buffer.append(I, 1);
+	}
+	buffer.append("\"");
+}
+
+bool ExportFile::Begin(std::vector<std::string>&& columnNames) {
+	if (output.is_open())
+		output.close();
+	output.clear();
+	columns = std::move(columnNames);
+	buffer.clear();
+	buffer.reserve(BufferSize);
+	rows = 0;
+	bytes = 0;
+	failed = false;
+
+	output.open(path, std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!output.is_open()) {
+		failed = true;
+		return false;
+	}
+
+	if (format == Csv) {
+		for (auto I(0U); I < columns.size(); ++I) {
+			if (I > 0)
+				buffer.append(",");
+			AppendCsvField(columns[I].c_str(), columns[I].length());
+		}
+		buffer.append("\r\n");
+	}
+	return true;
+}
+
+bool ExportFile::WriteRow(const char* const* values, const unsigned long* lengths) {
+	if (format == Csv) {
+		for (auto I(0U); I < columns.size(); ++I) {
+			if (I > 0)
+				buffer.append(",");
+			if (values[I] != nullptr)
+				AppendCsvField(values[I], lengths[I]);
+		}
+		buffer.append("\r\n");
+	}
+	else {
+		buffer.append("{");
+		for (auto I(0U); I < columns.size(); ++I) {
+			if (I > 0)
+				buffer.append(",");
+			buffer.append("\"");
+			buffer.append(Library::EscapeJsonString(columns[I]));
+			buffer.append("\":");
+			if (values[I] == nullptr)
+				buffer.append("null");
+			else {
+				buffer.append("\"");
+				buffer.append(Library::EscapeJsonString(std::string(values[I], lengths[I])));
+				buffer.append("\"");
+			}
+		}
+		buffer.append("}\n");
+	}
+	++rows;
+
+	return buffer.length() < BufferSize || Flush();
+}
+
+bool ExportFile::End() {
+	const auto flushed(Flush());
+	output.close();
+	return flushed && !output.fail() && !failed;
+}
+
+std::string ExportFile::GetError() const {
+	return "Failed to write export file " + path + "!";
+}
+
+std::string ExportFile::Summary() const {
+	return "{\"rows\":" + std::to_string(rows) + ",\"bytes\":" + std::to_string(bytes) + "}";
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+//Writes a result set to disk from the worker so the rows never go through DM. Rows are collected into a large buffer and written in big chunks, only the worker touches it once the query starts
+class ExportFile {
+public:
+	enum Format {
+		Ndjson,
+		Csv
+	};
+private:
+	static constexpr size_t BufferSize = 1 << 20;
+private:
+	const std::string path;
+	const Format format;
+	std::ofstream output;
+	std::vector<std::string> columns;
+	std::string buffer;
+	unsigned long long rows, bytes;
+	bool failed;
+private:
+	bool Flush();
+	void AppendCsvField(const char* const value, const size_t length);
+public:
+	ExportFile(const std::string& path, const Format format);
+	ExportFile(const ExportFile&) = delete;
+	ExportFile(ExportFile&&) = delete;
+
+	//false if we don't know how to write it
+	static bool ParseFormat(const std::string& name, Format& format);
+
+	//truncates the file and writes the header if the format has one, safe to call again to start over
+	bool Begin(std::vector<std::string>&& columnNames);
+	//one value and length per column, null values are written as SQL NULL
+	bool WriteRow(const char* const* values, const unsigned long* lengths);
+	bool End();
+
+	std::string GetError() const;
+	//{"rows":N,"bytes":N}, the only row DM gets back
+	std::string Summary() const;
+};
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "BSQL.h"
+
+Feed::Feed(const std::string& connectionIdentifier, std::string&& table, std::string&& keyColumn, const unsigned long long cursor, const std::chrono::steady_clock::duration interval, const unsigned int batch) :
+	Schedule(connectionIdentifier, std::string(), interval, Connection::Normal, 0),
+	table(std::move(table)),
+	keyColumn(std::move(keyColumn)),
+	keyField("\"" + Library::EscapeJsonString(this->keyColumn) + "\":\""),
+	batch(batch),
+	polledCursor(cursor),
+	readCursor(cursor),
+	runRows(0)
+{}
+
+std::string Feed::QuoteIdentifier(const std::string& identifier) {
+	//backticks work for both mysql and sqlite
+	std::string quoted("`");
+	for (const auto I : identifier) {
+		if (I == '`')
+			quoted.push_back('`');
+		quoted.push_back(I);
+	}
+	quoted.push_back('`');
+	return quoted;
+}
+
+std::string Feed::NextQuery() const {
+	const auto key(QuoteIdentifier(keyColumn));
+	std::string query("SELECT * FROM ");
+	query.append(QuoteIdentifier(table));
+	query.append(" WHERE ");
+	query.append(key);
+	query.append(" > ");
+	query.append(std::to_string(polledCursor));
+	query.append(" ORDER BY ");
+	query.append(key);
+	query.append(" LIMIT ");
+	query.append(std::to_string(batch));
+	return query;
+}
+
+bool Feed::Ready() const {
+	return rows.size() < static_cast<size_t>(batch) * BufferedBatches;
+}
+
+void Feed::TakeRow(std::string&& row) {
+	++runRows;
+	//a row without a usable key can't move the cursor, DM still gets it
+	auto key(polledCursor);
+	const auto field(row.find(keyField));
+	if (field != std::string::npos) {
+		const auto parsed(std::strtoull(row.c_str() + field + keyField.length(), nullptr, 10));
+		if (parsed > polledCursor)
+			key = parsed;
+	}
+	polledCursor = key;
+	rows.emplace_back(std::move(row), key);
+}
+
+void Feed::Finished(const bool failed) {
+	//a full batch means there's more already, don't wait out the interval for it
+	if (!failed && runRows >= batch && Ready())
+		nextRun = std::chrono::steady_clock::now();
+	runRows = 0;
+}
+
+std::string Feed::Read() {
+	const auto taken(std::min(rows.size(), static_cast<size_t>(batch)));
+	std::string rowsJson;
+	for (auto I(rows.begin()); I != rows.begin() + taken; ++I) {
+		if (I != rows.begin())
+			rowsJson.append(",");
+		rowsJson.append(I->first);
+	}
+	const auto cursor(taken == 0 ? readCursor : rows[taken - 1].second);
+
+	std::string json("{\"cursor\":\"");
+	json.append(std::to_string(cursor));
+	json.append("\",\"rows\":[");
+	json.append(rowsJson);
+	json.append("]}");
+
+	//only dropped once nothing else can throw
+	rows.erase(rows.begin(), rows.begin() + taken);
+	readCursor = cursor;
+	return json;
+}
+
+std::string Feed::GetStats() const {
+	auto json(Schedule::GetStats());
+	json.pop_back();
+	json.append(",\"cursor\":\"");
+	json.append(std::to_string(readCursor));
+	json.append("\",\"buffered\":");
+	json.append(std::to_string(rows.size()));
+	json.append("}");
+	return json;
+}
+
+bool Feed::IsFeed() const {
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+
+//A schedule that pages through an append only table by its increasing key, only rows past the last one it saw come back. Rows wait here until DM reads them, polling stops while too many are waiting
+class Feed : public Schedule {
+public:
+	static constexpr unsigned int DefaultBatch = 100;
+	static constexpr unsigned int MaxBatch = 10000;
+	//batches held for DM before polling backs off
+	static constexpr unsigned int BufferedBatches = 10;
+private:
+	const std::string table, keyColumn, keyField;
+	const unsigned int batch;
+	//key of the last row polled and of the last row handed to DM, what DM keeps to pick up where it left off
+	unsigned long long polledCursor, readCursor;
+	std::deque<std::pair<std::string, unsigned long long>> rows;
+	unsigned int runRows;
+private:
+	static std::string QuoteIdentifier(const std::string& identifier);
+protected:
+	std::string NextQuery() const override;
+	bool Ready() const override;
+	void TakeRow(std::string&& row) override;
+	void Finished(const bool failed) override;
+public:
+	Feed(const std::string& connectionIdentifier, std::string&& table, std::string&& keyColumn, const unsigned long long cursor, const std::chrono::steady_clock::duration interval, const unsigned int batch);
+
+	//{"cursor":"N","rows":[{...},...]} with up to a batch of the waiting rows, cursor is the key of the last one
+	std::string Read();
+
+	//the schedule stats plus "cursor":"N","buffered":N
+	std::string GetStats() const override;
+	bool IsFeed() const override;
+};
\ No newline at end of file
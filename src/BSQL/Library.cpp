@@ -1,14 +1,21 @@
 #include "BSQL.h"
 
-Library::Library() noexcept :
-	identifierCounter(0)
+Library::Library() :
+	identifierCounter(0),
+	parked(false),
+	dispatcher(*this)
 {
 	mysql_library_init(0, nullptr, nullptr);
 }
 
 Library::~Library() noexcept {
+	dispatcher.Stop();
+	//connections may hand us more zombies on their way out
+	connections.clear();
 	for (auto& I : zombieThreads)
-		I.join();
+		I.thread.join();
+	for (auto& I : parkedConnections)
+		mysql_close(I.second);
 	//https://jira.mariadb.org/browse/CONC-336
 	//mysql_library_end();
 }
@@ -21,7 +28,18 @@ Connection* Library::GetConnection(const std::string& identifier) noexcept {
 }
 
 bool Library::ReleaseConnection(const std::string& identifier) noexcept {
-	return connections.erase(identifier) > 0;
+	auto iter(connections.find(identifier));
+	if (iter == connections.end())
+		return false;
+	digests.Forget(*iter->second);
+	connections.erase(iter);
+	//their runs went with the connection
+	for (auto I(schedules.begin()); I != schedules.end();)
+		if (I->second->connectionIdentifier == identifier)
+			I = schedules.erase(I);
+		else
+			++I;
+	return true;
 }
 
 std::string Library::CreateConnection(Connection::Type type, const unsigned int asyncTimeout, const unsigned int blockingTimeout, const unsigned int threadLimit) noexcept {
@@ -34,9 +52,9 @@ std::string Library::CreateConnection(Connection::Type type, const unsigned int
 			case Connection::Type::MySql:
 				connections.emplace(identifier, std::make_unique<MySqlConnection>(*this, asyncTimeout, blockingTimeout, threadLimit));
 				break;
-			case Connection::Type::SqlServer:
-				--identifierCounter;
-				return std::string();
+			case Connection::Type::Sqlite:
+				connections.emplace(identifier, std::make_unique<SqliteConnection>(*this, asyncTimeout, blockingTimeout, threadLimit));
+				break;
 			}
 			return identifier;
 		}
@@ -46,14 +64,256 @@ std::string Library::CreateConnection(Connection::Type type, const unsigned int
 	return std::string();
 }
 
-void Library::RegisterZombieThread(std::thread&& thread) noexcept {
+void Library::RegisterZombieThread(std::thread&& thread, std::shared_ptr<std::atomic_bool>&& exited) noexcept {
+	ReapZombies();
+	Zombie zombie{ std::move(thread), std::move(exited) };
 	try {
-		zombieThreads.emplace_back(std::move(thread));
+		zombieThreads.emplace_back(std::move(zombie));
 	}
 	catch(std::bad_alloc&) {
 		//gotta wait then
-		thread.join();
+		zombie.thread.join();
+	}
+}
+
+void Library::ReapZombies() noexcept {
+	for (auto I(zombieThreads.begin()); I != zombieThreads.end();) {
+		if (I->exited && *I->exited) {
+			I->thread.join();
+			I = zombieThreads.erase(I);
+		}
+		else
+			++I;
+	}
+}
+
+void Library::Park() noexcept {
+	//captures and schedules belong to the round
+	recorder.reset();
+	schedules.clear();
+	for (auto& I : connections) {
+		digests.Forget(*I.second);
+		I.second->Park();
+	}
+	connections.clear();
+	ReapZombies();
+	parked = true;
+	//long enough for the next round to get its connections open
+	parkedUntil = std::chrono::steady_clock::now() + std::chrono::minutes(1);
+	dispatcher.Wake();
+}
+
+bool Library::Unpark() noexcept {
+	const auto wasParked(parked);
+	parked = false;
+	return wasParked;
+}
+
+void Library::ParkConnection(const std::string& key, MYSQL* connection) noexcept {
+	try {
+		parkedConnections.emplace(key, connection);
+	}
+	catch (std::bad_alloc&) {
+		mysql_close(connection);
+	}
+}
+
+MYSQL* Library::ClaimConnection(const std::string& key) noexcept {
+	auto iter(parkedConnections.find(key));
+	if (iter == parkedConnections.end())
+		return nullptr;
+	const auto connection(iter->second);
+	parkedConnections.erase(iter);
+	return connection;
+}
+
+std::unique_lock<std::mutex> Library::Lock() noexcept {
+	return std::unique_lock<std::mutex>(lock);
+}
+
+Dispatcher& Library::GetDispatcher() noexcept {
+	return dispatcher;
+}
+
+bool Library::DispatchPending() noexcept {
+	std::lock_guard<std::mutex> guard(lock);
+	//finished EXPLAINs hand their handles back before anything else starts
+	try {
+		digests.CollectPlans();
+	}
+	catch (std::bad_alloc&) {
+		//try again later
+	}
+	catch (std::system_error&) {
+		//out of threads, same deal
+	}
+	//one start per connection per round so a busy connection can't keep the rest waiting
+	auto pending(false), started(true);
+	while (started) {
+		started = false;
+		pending = false;
+		for (auto& I : connections) {
+			try {
+				if (I.second->StartNext())
+					started = true;
+			}
+			catch (std::bad_alloc&) {
+				//try again later
+			}
+			catch (std::system_error&) {
+				//out of threads, same deal
+			}
+			pending = pending || I.second->HasPending();
+		}
+	}
+	return pending;
+}
+
+QueryDigests& Library::GetDigests() noexcept {
+	return digests;
+}
+
+std::string Library::AddSchedule(std::unique_ptr<Schedule>&& schedule) noexcept {
+	if (identifierCounter < std::numeric_limits<unsigned long long>().max()) {
+		try {
+			auto identifier(std::to_string(++identifierCounter));
+			schedules.emplace(identifier, std::move(schedule));
+			dispatcher.Wake();
+			return identifier;
+		}
+		catch (std::bad_alloc&) {
+		}
 	}
+	return std::string();
+}
+
+Schedule* Library::GetSchedule(const std::string& identifier) noexcept {
+	auto iter(schedules.find(identifier));
+	if (iter == schedules.end())
+		return nullptr;
+	return iter->second.get();
+}
+
+bool Library::ReleaseSchedule(const std::string& identifier) {
+	auto iter(schedules.find(identifier));
+	if (iter == schedules.end())
+		return false;
+	const auto connection(GetConnection(iter->second->connectionIdentifier));
+	if (connection)
+		iter->second->Stop(*connection);
+	schedules.erase(iter);
+	return true;
+}
+
+std::chrono::steady_clock::time_point Library::RunSchedules() noexcept {
+	std::lock_guard<std::mutex> guard(lock);
+	const auto now(std::chrono::steady_clock::now());
+	auto next(std::chrono::steady_clock::time_point::max());
+	for (auto I(schedules.begin()); I != schedules.end();) {
+		const auto connection(GetConnection(I->second->connectionIdentifier));
+		if (!connection) {
+			I = schedules.erase(I);
+			continue;
+		}
+		try {
+			next = std::min(next, I->second->Run(*connection, now));
+		}
+		catch (std::bad_alloc&) {
+			//try again later
+		}
+		catch (std::system_error&) {
+			//out of threads, same deal
+		}
+		++I;
+	}
+	return next;
+}
+
+std::chrono::steady_clock::time_point Library::RunMaintenance() noexcept {
+	std::multimap<std::string, MYSQL*> expired;
+	auto next(std::chrono::steady_clock::time_point::max());
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		const auto now(std::chrono::steady_clock::now());
+		for (auto& I : connections) {
+			try {
+				next = std::min({ next, I.second->ReclaimIdle(now), I.second->ReplaySpool(now) });
+			}
+			catch (std::bad_alloc&) {
+				//try again later
+			}
+			catch (std::system_error&) {
+				//out of threads, same deal
+			}
+		}
+		if (!parkedConnections.empty()) {
+			if (now >= parkedUntil)
+				std::swap(expired, parkedConnections);
+			else
+				next = std::min(next, parkedUntil);
+		}
+	}
+	//saying goodbye to the server is a round trip, nobody has to wait on it
+	for (auto& I : expired)
+		mysql_close(I.second);
+	return next;
+}
+
+bool Library::StartCapture(const std::string& path) noexcept {
+	try {
+		auto newRecorder(std::make_unique<TrafficRecorder>(path));
+		if (!newRecorder->Good())
+			return false;
+		recorder = std::move(newRecorder);
+		return true;
+	}
+	catch (std::bad_alloc&) {
+		return false;
+	}
+}
+
+void Library::StopCapture() noexcept {
+	recorder.reset();
+}
+
+TrafficRecorder* Library::GetRecorder() noexcept {
+	return recorder.get();
+}
+
+static std::string url_decode(const std::string& s) {
+	std::string result;
+	result.reserve(s.length());
+	for (auto I(0U); I < s.length(); ++I) {
+		if (s[I] == '+')
+			result.push_back(' ');
+		else if (s[I] == '%' && I + 2 < s.length() && std::isxdigit(static_cast<unsigned char>(s[I + 1])) && std::isxdigit(static_cast<unsigned char>(s[I + 2]))) {
+			result.push_back(static_cast<char>(std::stoi(s.substr(I + 1, 2), nullptr, 16)));
+			I += 2;
+		}
+		else
+			result.push_back(s[I]);
+	}
+	return result;
+}
+
+std::map<std::string, std::string> Library::ParseParams(const std::string& params) {
+	std::map<std::string, std::string> result;
+	std::string::size_type start(0);
+	while (start < params.length()) {
+		auto end(params.find('&', start));
+		if (end == std::string::npos)
+			end = params.length();
+		const auto pair(params.substr(start, end - start));
+		const auto equals(pair.find('='));
+		if (!pair.empty()) {
+			if (equals == std::string::npos)
+				result[url_decode(pair)] = std::string();
+			else
+				result[url_decode(pair.substr(0, equals))] = url_decode(pair.substr(equals + 1));
+		}
+		start = end + 1;
+	}
+	return result;
 }
 
 //code below from here: https://github.com/nlohmann/json/blob/ec7a1d834773f9fee90d8ae908a0c9933c5646fc/src/json.hpp#L4604-L4697
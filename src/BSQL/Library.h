@@ -1,19 +1,69 @@
 #pragma once
 
 class Library {
+private:
+	struct Zombie {
+		std::thread thread;
+		std::shared_ptr<std::atomic_bool> exited;
+	};
 private:
 	unsigned long long identifierCounter;
+	//set by a soft shutdown, only then does the next Initialize keep us
+	bool parked;
 
+	//held by every api call and the dispatcher, connections and operations are not thread safe
+	std::mutex lock;
 	std::map<std::string, std::unique_ptr<Connection>> connections;
-	std::deque<std::thread> zombieThreads;
+	//a soft shutdown never destroys us, so the ones that finished are joined as we go
+	std::deque<Zombie> zombieThreads;
+	std::unique_ptr<TrafficRecorder> recorder;
+	//idle handles kept through a soft shutdown, keyed by everything that went into making them
+	std::multimap<std::string, MYSQL*> parkedConnections;
+	//the ones the next round didn't want by then are closed
+	std::chrono::steady_clock::time_point parkedUntil;
+	std::map<std::string, std::unique_ptr<Schedule>> schedules;
+	QueryDigests digests;
+	Dispatcher dispatcher;
 public:
-	Library() noexcept;
+	Library();
 	~Library() noexcept;
 
 	static std::string EscapeJsonString(const std::string& str);
+	//reads the output of DM's list2params()
+	static std::map<std::string, std::string> ParseParams(const std::string& params);
 
 	std::string CreateConnection(Connection::Type connectionType, const unsigned int asyncTimeout, const unsigned int blockingTimeout, const unsigned int threadLimit) noexcept;
 	Connection* GetConnection(const std::string& identifier) noexcept;
 	bool ReleaseConnection(const std::string& identifier) noexcept;
-	void RegisterZombieThread(std::thread&& thread) noexcept;
+	//exited is the operation's WorkerExited()
+	void RegisterZombieThread(std::thread&& thread, std::shared_ptr<std::atomic_bool>&& exited) noexcept;
+	//joins the zombies that are done
+	void ReapZombies() noexcept;
+
+	//releases every connection but keeps their idle handles and the threads running, for a world reboot
+	void Park() noexcept;
+	//true if the last round ended with Park, which is then forgotten
+	bool Unpark() noexcept;
+	void ParkConnection(const std::string& key, MYSQL* connection) noexcept;
+	//null if nothing was parked under the key
+	MYSQL* ClaimConnection(const std::string& key) noexcept;
+
+	std::unique_lock<std::mutex> Lock() noexcept;
+	Dispatcher& GetDispatcher() noexcept;
+	//starts what it can on each connection in turn, returns true if anything is still waiting
+	bool DispatchPending() noexcept;
+	QueryDigests& GetDigests() noexcept;
+
+	//empty if it couldn't be added, the dispatcher takes it from here
+	std::string AddSchedule(std::unique_ptr<Schedule>&& schedule) noexcept;
+	Schedule* GetSchedule(const std::string& identifier) noexcept;
+	bool ReleaseSchedule(const std::string& identifier);
+	//dispatcher side, runs whatever is due, returns when the next one is due
+	std::chrono::steady_clock::time_point RunSchedules() noexcept;
+	//dispatcher side, see Connection::ReclaimIdle and Connection::ReplaySpool, also closes parked handles past parkedUntil
+	std::chrono::steady_clock::time_point RunMaintenance() noexcept;
+
+	bool StartCapture(const std::string& path) noexcept;
+	void StopCapture() noexcept;
+	TrafficRecorder* GetRecorder() noexcept;
 };
\ No newline at end of file
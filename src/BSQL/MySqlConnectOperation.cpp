@@ -1,45 +1,89 @@
 #include "BSQL.h"
 
-MySqlConnectOperation::MySqlConnectOperation(MySqlConnection& connPool, const std::string& address, const unsigned short port, const std::string& username, const std::string& password, const std::string& database, const unsigned int timeout, std::atomic_uint_fast32_t& threadCounter, const unsigned int threadLimit) :
+MySqlConnectOperation::MySqlConnectOperation(MySqlConnection& connPool, const unsigned int pool, const unsigned int generation, MYSQL* warm, const std::string& address, const unsigned short port, const std::string& username, const std::string& password, const std::string& database, const MySqlConnection::Options& options, const unsigned int timeout, const std::shared_ptr<std::atomic_uint_fast32_t>& threadCounter, ConcurrencyLimit& threadLimit, Dispatcher& dispatcher) :
 	connPool(connPool),
+	pool(pool),
+	generation(generation),
 	mysql(nullptr),
+	warm(warm),
 	address(address),
 	username(username),
 	password(password),
 	database(database),
 	port(port),
+	options(options),
 	complete(false),
 	started(false),
 	state(std::make_shared<ClassState>()),
 	threadCounter(threadCounter),
 	threadLimit(threadLimit),
-	timeout(timeout)
+	timeout(timeout),
+	dispatcher(dispatcher)
 {
 	TryStartConnecting();
 }
 
+MySqlConnectOperation::~MySqlConnectOperation() {
+	//never got a worker
+	if (warm)
+		mysql_close(warm);
+}
+
 void MySqlConnectOperation::TryStartConnecting() {
-	if (threadCounter.fetch_add(1) > threadLimit) {
-		--threadCounter;
+	if (threadCounter->fetch_add(1) > threadLimit.Current()) {
+		--*threadCounter;
 		return;
 	}
+	const auto fresh(InitMySql(timeout, options));
 	started = true;
-	connectThread = std::thread(&MySqlConnectOperation::DoConnect, this, InitMySql(timeout), state);
+	connectThread = std::thread(&MySqlConnectOperation::DoConnect, this, fresh, warm, address, username, password, database, port, threadCounter, std::ref(dispatcher), state, NewWorkerFlag());
+	warm = nullptr;
 }
 
-MYSQL* MySqlConnectOperation::InitMySql(const unsigned int timeout) {
+MYSQL* MySqlConnectOperation::InitMySql(const unsigned int timeout, const MySqlConnection::Options& options) {
 	const auto res(mysql_init(nullptr));
 	if (!res)
 		throw std::bad_alloc();
 	mysql_options(res, MYSQL_OPT_CONNECT_TIMEOUT, static_cast<const void*>(&timeout));
 	mysql_options(res, MYSQL_OPT_READ_TIMEOUT, static_cast<const void*>(&timeout));
 	mysql_options(res, MYSQL_OPT_WRITE_TIMEOUT, static_cast<const void*>(&timeout));
+	if (options.compress)
+		mysql_options(res, MYSQL_OPT_COMPRESS, nullptr);
+	if (options.netBufferLength)
+		mysql_options(res, MYSQL_OPT_NET_BUFFER_LENGTH, static_cast<const void*>(&options.netBufferLength));
+	if (options.maxAllowedPacket)
+		mysql_options(res, MYSQL_OPT_MAX_ALLOWED_PACKET, static_cast<const void*>(&options.maxAllowedPacket));
+	if (!options.charset.empty())
+		mysql_options(res, MYSQL_SET_CHARSET_NAME, static_cast<const void*>(options.charset.c_str()));
+	if (options.tls) {
+		const my_bool enforce(1);
+		mysql_options(res, MYSQL_OPT_SSL_ENFORCE, static_cast<const void*>(&enforce));
+	}
+	if (options.tlsVerify) {
+		const my_bool verify(1);
+		mysql_options(res, MYSQL_OPT_SSL_VERIFY_SERVER_CERT, static_cast<const void*>(&verify));
+	}
+	if (!options.tlsCa.empty())
+		mysql_options(res, MYSQL_OPT_SSL_CA, static_cast<const void*>(options.tlsCa.c_str()));
 	return res;
 }
 
-void MySqlConnectOperation::DoConnect(MYSQL* localMySql, std::shared_ptr<ClassState> localState) {
+void MySqlConnectOperation::DoConnect(MYSQL* localMySql, MYSQL* localWarm, const std::string localAddress, const std::string localUsername, const std::string localPassword, const std::string localDatabase, const unsigned short localPort, std::shared_ptr<std::atomic_uint_fast32_t> localThreadCounter, Dispatcher& localDispatcher, std::shared_ptr<ClassState> localState, std::shared_ptr<std::atomic_bool> localExited) {
+	const ExitGuard exitGuard(localExited);
 	mysql_thread_init();
-	const auto result(mysql_real_connect(localMySql, address.c_str(), username.c_str(), password.c_str(), database.empty() ? nullptr : database.c_str(), port, nullptr, 0));
+	//the operation may be gone before this returns, don't touch it until we know it's alive
+	MYSQL* result(nullptr);
+	//the next round mustn't inherit transactions, table locks, temporary tables or variables from the last one
+	if (localWarm && mysql_reset_connection(localWarm) == 0) {
+		mysql_close(localMySql);
+		localMySql = localWarm;
+		result = localWarm;
+	}
+	else {
+		if (localWarm)
+			mysql_close(localWarm);
+		result = mysql_real_connect(localMySql, localAddress.c_str(), localUsername.c_str(), localPassword.c_str(), localDatabase.empty() ? nullptr : localDatabase.c_str(), localPort, nullptr, CLIENT_MULTI_RESULTS);
+	}
 	localState->lock.lock();
 	if (localState->alive) {
 		error = mysql_error(localMySql);
@@ -52,7 +96,9 @@ void MySqlConnectOperation::DoConnect(MYSQL* localMySql, std::shared_ptr<ClassSt
 		mysql_close(localMySql);
 	mysql_thread_end();
 	localState->lock.unlock();
-	--threadCounter;
+	--*localThreadCounter;
+	//dispatcher outlives us, unlike the operation
+	localDispatcher.Wake();
 }
 
 bool MySqlConnectOperation::IsQuery() {
@@ -71,7 +117,7 @@ bool MySqlConnectOperation::IsComplete(bool noSkip) {
 	if (mysql) {
 		auto tmp(mysql);
 		mysql = nullptr;	//recursion issue
-		connPool.ReleaseConnection(tmp);
+		connPool.ReleaseConnection(tmp, pool, generation);
 	}
 
 	return true;
@@ -85,7 +131,8 @@ std::thread* MySqlConnectOperation::GetActiveThread() {
 
 	if (IsComplete(false)) {
 		state->lock.unlock();
-		connectThread.join();
+		if (connectThread.joinable())
+			connectThread.join();
 		return nullptr;
 	}
 
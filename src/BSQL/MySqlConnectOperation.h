@@ -3,27 +3,35 @@
 class MySqlConnectOperation : public Operation {
 private:
 	MySqlConnection& connPool;
+	const unsigned int pool, generation;
 	MYSQL *mysql;
+	//ours until the worker takes it
+	MYSQL *warm;
 
 	const std::string address, username, password, database;
 	const unsigned short port;
+	const MySqlConnection::Options options;
 
-	bool complete, started;
+	std::atomic_bool complete;
+	bool started;
 	std::shared_ptr<ClassState> state;
 	std::thread connectThread;
-	std::atomic_uint_fast32_t& threadCounter;
-	const unsigned int threadLimit, timeout;
+	const std::shared_ptr<std::atomic_uint_fast32_t> threadCounter;
+	ConcurrencyLimit& threadLimit;
+	const unsigned int timeout;
+	Dispatcher& dispatcher;
 	
 private:
-	static MYSQL* InitMySql(const unsigned int timeout);
+	static MYSQL* InitMySql(const unsigned int timeout, const MySqlConnection::Options& options);
 
 	void TryStartConnecting();
-	void DoConnect(MYSQL* localMySql, std::shared_ptr<ClassState> localState);
+	void DoConnect(MYSQL* localMySql, MYSQL* localWarm, const std::string localAddress, const std::string localUsername, const std::string localPassword, const std::string localDatabase, const unsigned short localPort, std::shared_ptr<std::atomic_uint_fast32_t> localThreadCounter, Dispatcher& localDispatcher, std::shared_ptr<ClassState> localState, std::shared_ptr<std::atomic_bool> localExited);
 public:
-	MySqlConnectOperation(MySqlConnection& connPool, const std::string& address, const unsigned short port, const std::string& username, const std::string& password, const std::string& database, const unsigned int timeout, std::atomic_uint_fast32_t& threadCounter, const unsigned int threadLimit);
+	//warm is an open handle from the last round, the worker resets it instead of connecting and only connects if that fails
+	MySqlConnectOperation(MySqlConnection& connPool, const unsigned int pool, const unsigned int generation, MYSQL* warm, const std::string& address, const unsigned short port, const std::string& username, const std::string& password, const std::string& database, const MySqlConnection::Options& options, const unsigned int timeout, const std::shared_ptr<std::atomic_uint_fast32_t>& threadCounter, ConcurrencyLimit& threadLimit, Dispatcher& dispatcher);
 	MySqlConnectOperation(const MySqlConnectOperation&) = delete;
 	MySqlConnectOperation(MySqlConnectOperation&&) = delete;
-	~MySqlConnectOperation() override = default;
+	~MySqlConnectOperation() override;
 
 	bool IsComplete(bool noSkip) override;
 	bool IsQuery() override;
@@ -1,56 +1,201 @@
 #include "BSQL.h"
 
+MySqlConnection::Pool::Pool(const std::string& address, const unsigned short port) :
+	address(address),
+	port(port),
+	generation(0),
+	lagging(false)
+{}
+
 MySqlConnection::MySqlConnection(Library& library, const unsigned int asyncTimeout, const unsigned int blockingTimeout, const unsigned int threadLimit) :
-	Connection(Type::MySql, library, blockingTimeout),
+	Connection(Type::MySql, library, blockingTimeout, threadLimit),
+	options(),
+	nextReplica(0),
 	firstSuccessfulConnection(nullptr),
+	firstConnectionReleased(std::make_shared<std::atomic_bool>(false)),
 	asyncTimeout(asyncTimeout),
-	threadLimit(threadLimit),
-	threadCounter(0)
+	threadCounter(std::make_shared<std::atomic_uint_fast32_t>(0)),
+	spoolRate(100),
+	nextReplay(std::chrono::steady_clock::now())
 {}
 
 MySqlConnection::~MySqlConnection() {
+	//nothing should start while we tear down
+	ClearPending();
 	//do this first so all reserved connections are returned to the queue
 	for (auto& I : operations) {
 		auto thread(I.second->GetActiveThread());
 		if (thread)
-			library.RegisterZombieThread(std::move(*thread));
+			library.RegisterZombieThread(std::move(*thread), I.second->WorkerExited());
+	}
+	{
+		//their destructors hand handles back through ReleaseConnection, which looks at operations
+		const auto dying(std::move(operations));
+		operations.clear();
 	}
-	operations.clear();
 	//and release them
-	while (!availableConnections.empty()) {
-		auto front(availableConnections.top());
-		mysql_close(front);
-		if (front == firstSuccessfulConnection)
-			firstSuccessfulConnection = nullptr;
-		availableConnections.pop();
-	}
-	if (firstSuccessfulConnection)
+	for (auto& pool : pools) {
+		while (!pool.availableConnections.empty()) {
+			auto front(pool.availableConnections.top());
+			mysql_close(front);
+			if (front == firstSuccessfulConnection)
+				firstSuccessfulConnection = nullptr;
+			pool.availableConnections.pop();
+		}
+		while (!pool.warmConnections.empty()) {
+			mysql_close(pool.warmConnections.top());
+			pool.warmConnections.pop();
+		}
+	}
+	if (firstSuccessfulConnection && firstConnectionReleased->exchange(true))
 		mysql_close(firstSuccessfulConnection);
 }
 
+static bool ParseSwitch(const std::string& value, bool& output) {
+	if (value != "0" && value != "1")
+		return false;
+	output = value == "1";
+	return true;
+}
+
+static bool ParseReplicas(const std::string& value, std::vector<std::pair<std::string, unsigned short>>& output) {
+	output.clear();
+	std::string::size_type start(0);
+	while (start <= value.length()) {
+		auto end(value.find(',', start));
+		if (end == std::string::npos)
+			end = value.length();
+		auto host(value.substr(start, end - start));
+		start = end + 1;
+		if (host.empty())
+			continue;
+		unsigned short port(0);
+		const auto colon(host.rfind(':'));
+		if (colon != std::string::npos) {
+			const auto portString(host.substr(colon + 1));
+			if (portString.empty() || portString.length() > 5 || portString.find_first_not_of("0123456789") != std::string::npos)
+				return false;
+			const auto asInt(std::stoi(portString));
+			if (asInt > std::numeric_limits<unsigned short>::max())
+				return false;
+			port = static_cast<unsigned short>(asInt);
+			host.resize(colon);
+		}
+		output.emplace_back(std::move(host), port);
+	}
+	return true;
+}
+
+std::string MySqlConnection::Configure(const std::map<std::string, std::string>& newOptions) {
+	//handles already made won't pick them up
+	if (!pools.empty())
+		return "Connection options must be set before connecting!";
+
+	auto parsed(options);
+	auto limits(queueLimits);
+	auto ttl(operationTtl);
+	std::string spoolPath;
+	auto spoolMaxBytes(64UL << 20);
+	auto rate(spoolRate);
+	for (const auto& I : newOptions) {
+		const auto& key(I.first), value(I.second);
+		bool valid;
+		if (key == "compress")
+			valid = ParseSwitch(value, parsed.compress);
+		else if (key == "tls")
+			valid = ParseSwitch(value, parsed.tls);
+		else if (key == "tls_verify")
+			valid = ParseSwitch(value, parsed.tlsVerify);
+		else if (key == "store_result")
+			valid = ParseSwitch(value, parsed.storeResult);
+		else if (key == "net_buffer_length")
+			valid = ParseSize(value, parsed.netBufferLength);
+		else if (key == "max_allowed_packet")
+			valid = ParseSize(value, parsed.maxAllowedPacket);
+		else if (key == "replica_max_lag")
+			valid = ParseSize(value, parsed.replicaMaxLag);
+		else if (key == "concurrency_min")
+			valid = ParseSize(value, parsed.concurrencyMin) && parsed.concurrencyMin <= std::numeric_limits<unsigned int>::max();
+		else if (key == "concurrency_max")
+			valid = ParseSize(value, parsed.concurrencyMax) && parsed.concurrencyMax <= std::numeric_limits<unsigned int>::max();
+		else if (key == "replicas")
+			valid = ParseReplicas(value, parsed.replicas);
+		else if (key == "charset") {
+			parsed.charset = value;
+			valid = true;
+		}
+		else if (key == "tls_ca") {
+			parsed.tlsCa = value;
+			valid = true;
+		}
+		else if (key == "spool_path") {
+			spoolPath = value;
+			valid = !value.empty();
+		}
+		else if (key == "spool_max_bytes")
+			valid = ParseSize(value, spoolMaxBytes) && spoolMaxBytes > 0;
+		else if (key == "spool_rate")
+			valid = ParseSize(value, rate) && rate > 0;
+		else if (!ParseCommonOption(key, value, limits, ttl, valid))
+			return "Unknown connection option: " + key + "!";
+		if (!valid)
+			return "Invalid value for connection option " + key + "!";
+	}
+	if (parsed.concurrencyMin != 0 || parsed.concurrencyMax != 0) {
+		const auto minimum(parsed.concurrencyMin != 0 ? static_cast<unsigned int>(parsed.concurrencyMin) : 1U);
+		const auto maximum(parsed.concurrencyMax != 0 ? static_cast<unsigned int>(parsed.concurrencyMax) : std::max(threadLimit.Current(), minimum));
+		if (minimum > maximum)
+			return "concurrency_min must not be greater than concurrency_max!";
+		threadLimit.MakeAdaptive(minimum, maximum);
+	}
+	if (!spoolPath.empty()) {
+		auto newSpool(std::make_unique<Spool>(spoolPath, spoolMaxBytes));
+		if (!newSpool->Open())
+			return "Unable to open spool file " + spoolPath + "!";
+		spool = std::move(newSpool);
+	}
+	spoolRate = rate;
+	options = std::move(parsed);
+	queueLimits = limits;
+	operationTtl = ttl;
+	return std::string();
+}
+
 std::string MySqlConnection::Connect(const std::string& address, const unsigned short port, const std::string& username, const std::string& password, const std::string& database) {
 	//can't connect twice
-	if (!operations.empty() || !availableConnections.empty())
+	if (!pools.empty())
 		return std::string();
 
-	this->address = address;
-	this->port = port;
 	this->username = username;
 	this->password = password;
 	this->database = database;
-	int tmp;
-	LoadNewConnection(newestConnectionAttemptKey, tmp);
-	newestConnectionAttemptKey = std::string();
-	return operations.begin()->first;
+	pools.reserve(options.replicas.size() + 1);
+	pools.emplace_back(address, port);
+	for (const auto& I : options.replicas)
+		pools.emplace_back(I.first, I.second ? I.second : port);
+
+	//take over what the last round left behind, they're reset as they're needed instead of connecting
+	for (auto I(0U); I < pools.size(); ++I)
+		for (auto warm(library.ClaimConnection(ParkingKey(I))); warm; warm = library.ClaimConnection(ParkingKey(I)))
+			pools[I].warmConnections.emplace(warm);
+
+	//replicas connect when the first read needs them
+	std::string fail;
+	int failno;
+	LoadNewConnection(0, fail, failno);
+	std::string connectOp;
+	std::swap(connectOp, pools[0].newestConnectionAttemptKey);
+	return connectOp;
 }
 
-bool MySqlConnection::LoadNewConnection(std::string& fail, int& failno) {
-	if (!newestConnectionAttemptKey.empty()) {
+bool MySqlConnection::LoadNewConnection(const unsigned int pool, std::string& fail, int& failno) {
+	auto& target(pools[pool]);
+	if (!target.newestConnectionAttemptKey.empty()) {
 		//this will chain into calling ReleaseConnection and clear the var
-		auto nca(newestConnectionAttemptKey);
+		auto nca(target.newestConnectionAttemptKey);
 		auto& op(*GetOperation(nca));
 		if (op.IsComplete(false)) {
-			const auto success(availableConnections.size() > 0);
+			const auto success(target.availableConnections.size() > 0);
 			if (success) {
 				ReleaseOperation(nca);
 				return true;
@@ -65,37 +210,306 @@ bool MySqlConnection::LoadNewConnection(std::string& fail, int& failno) {
 			return false;
 	}
 
-	newestConnectionAttemptKey = AddOp(std::make_unique<MySqlConnectOperation>(*this, address, port, username, password, database, asyncTimeout, threadCounter, threadLimit));
+	MYSQL* warm(nullptr);
+	if (!target.warmConnections.empty()) {
+		warm = target.warmConnections.top();
+		target.warmConnections.pop();
+	}
+	target.newestConnectionAttemptKey = AddOp(std::make_unique<MySqlConnectOperation>(*this, pool, target.generation, warm, target.address, target.port, username, password, database, options, asyncTimeout, threadCounter, threadLimit, library.GetDispatcher()));
 
 	return false;
 }
 
-std::string MySqlConnection::CreateQuery(const std::string& queryText) {
-	return AddOp(std::make_unique<MySqlQueryOperation>(*this, std::string(queryText), threadCounter, threadLimit));
+//conservative, anything that might lean on session state or take locks stays on the primary and isn't run twice
+static bool IsPlainRead(const std::string& queryText) {
+	std::string upper(queryText);
+	std::transform(upper.begin(), upper.end(), upper.begin(), [](const char c) { return static_cast<char>(std::toupper(static_cast<unsigned char>(c))); });
+
+	auto start(upper.find_first_not_of(" \t\r\n("));
+	if (start == std::string::npos || upper.compare(start, 6, "SELECT") != 0)
+		return false;
+
+	static const char* const unsafe[] = { "FOR UPDATE", "LOCK IN SHARE MODE", "INTO", "@", "LAST_INSERT_ID", "FOUND_ROWS", "ROW_COUNT", "GET_LOCK", "RELEASE_LOCK", "IS_FREE_LOCK", "IS_USED_LOCK", "NEXTVAL", "LASTVAL", "SETVAL" };
+	for (const auto I : unsafe)
+		if (upper.find(I) != std::string::npos)
+			return false;
+	return true;
 }
 
-MYSQL* MySqlConnection::RequestConnection(std::string& fail, int& failno, bool& doNotClose) {
-	if (availableConnections.empty() && !LoadNewConnection(fail, failno))
-		return nullptr;
+std::string MySqlConnection::CreateQuery(const std::string& queryText, const Priority priority, const unsigned int flags, std::unique_ptr<ExportFile>&& exportFile, const bool reclaimable) {
+	const auto storeResult((flags & StoreResult) != 0 || ((flags & UseResult) == 0 && options.storeResult));
+	const auto plainRead(IsPlainRead(queryText));
+	const auto replicaSafe(pools.size() > 1 && (flags & Primary) == 0 && plainRead);
+	const auto chunked((flags & Chunked) != 0);
+	//a shared read's error goes to everyone who joined it, so it isn't retried. Blobs belong to the query that read them so chunked reads go alone
+	const auto shared((flags & Shared) != 0 && plainRead && !exportFile && !chunked);
+	const auto deferrable((flags & Deferrable) != 0 && spool && !plainRead && !exportFile);
+	auto query(std::make_unique<MySqlQueryOperation>(*this, std::string(queryText), std::move(exportFile), chunked, priority, storeResult, replicaSafe, plainRead && !shared, shared, deferrable, -1, threadCounter, threadLimit, library.GetDispatcher()));
+	//older writes are still waiting on the spool, this one goes in behind them rather than ahead. If it's full the server gets a chance at it first
+	if (deferrable && !spool->Empty() && SpoolWrite(queryText, false)) {
+		if (reclaimable)
+			query->SetReclaimable();
+		query->MarkSpooled();
+		return AddOp(std::move(query));
+	}
+	return AdmitQuery(std::move(query), queryText, priority, reclaimable);
+}
+
+std::string MySqlConnection::Explain(const std::string& queryText) {
+	//a spare handle from the pool, a replica's plan is as good as the primary's
+	return AddQuery(std::make_unique<MySqlQueryOperation>(*this, "EXPLAIN " + queryText, nullptr, false, Bulk, true, pools.size() > 1, true, false, false, -1, threadCounter, threadLimit, library.GetDispatcher()), Bulk);
+}
+
+void MySqlConnection::CheckLag(const unsigned int pool) {
+	//a replica that can't say how far behind it is gets treated as too far
+	const auto checkInterval(std::chrono::seconds(1));
+	auto& target(pools[pool]);
+	const auto now(std::chrono::steady_clock::now());
+
+	if (target.lagCheckKey.empty()) {
+		if (now - target.lagCheckedAt >= checkInterval)
+			target.lagCheckKey = AddQuery(std::make_unique<MySqlQueryOperation>(*this, "SHOW SLAVE STATUS", nullptr, false, Interactive, true, true, true, false, false, static_cast<int>(pool), threadCounter, threadLimit, library.GetDispatcher()), Interactive);
+		return;
+	}
+
+	auto& check(*static_cast<Query*>(GetOperation(target.lagCheckKey)));
+	//no rows at all when it isn't replicating, every channel has to be within the limit
+	auto lagging(true), reported(false);
+	for (;;) {
+		if (!check.IsComplete(false))
+			return;
+		const auto row(check.CurrentRow());
+		if (row.empty())
+			break;
+		const auto field(row.find("\"Seconds_Behind_Master\":"));
+		if (field == std::string::npos)
+			continue;
+		const auto value(row.c_str() + field + 24);
+		//null when replication isn't running
+		char* end(nullptr);
+		const auto within(*value == '"' && std::isdigit(static_cast<unsigned char>(value[1])) && std::strtoul(value + 1, &end, 10) <= options.replicaMaxLag && *end == '"');
+		lagging = (reported && lagging) || !within;
+		reported = true;
+	}
+	if (!check.GetError().empty())
+		lagging = true;
+
+	target.lagging = lagging;
+	target.lagCheckedAt = now;
+	std::string key;
+	std::swap(key, target.lagCheckKey);
+	ReleaseOperation(key);
+}
+
+unsigned int MySqlConnection::PickReplica() {
+	const auto now(std::chrono::steady_clock::now());
+	const auto replicaCount(static_cast<unsigned int>(pools.size() - 1));
+	for (auto I(0U); I < replicaCount; ++I) {
+		const auto pool(1 + (nextReplica + I) % replicaCount);
+		if (options.replicaMaxLag)
+			CheckLag(pool);
+		const auto& target(pools[pool]);
+		if (target.downUntil > now || target.lagging)
+			continue;
+		nextReplica = (nextReplica + I + 1) % replicaCount;
+		return pool;
+	}
+	return 0;
+}
 
-	auto front(availableConnections.top());
-	availableConnections.pop();
-	doNotClose = front == firstSuccessfulConnection;
+MYSQL* MySqlConnection::RequestConnection(const bool replicaSafe, const int pinnedPool, unsigned int& pool, unsigned int& generation, std::string& fail, int& failno, std::shared_ptr<std::atomic_bool>& sharedRelease) {
+	//how long to leave a replica we couldn't connect to alone
+	const auto replicaRetry(std::chrono::seconds(10));
+
+	if (pinnedPool >= 0)
+		pool = static_cast<unsigned int>(pinnedPool);
+	else
+		pool = replicaSafe ? PickReplica() : 0;
+
+	auto& target(pools[pool]);
+	if (target.availableConnections.empty() && !LoadNewConnection(pool, fail, failno)) {
+		if (pinnedPool >= 0 || pool == 0 || fail.empty())
+			return nullptr;
+		//replica is unreachable, send it to the primary instead
+		target.downUntil = std::chrono::steady_clock::now() + replicaRetry;
+		fail = std::string();
+		pool = 0;
+		return RequestConnection(false, 0, pool, generation, fail, failno, sharedRelease);
+	}
+
+	auto front(target.availableConnections.top());
+	target.availableConnections.pop();
+	generation = target.generation;
+	if (front == firstSuccessfulConnection)
+		sharedRelease = firstConnectionReleased;
+	else
+		sharedRelease.reset();
 	return front;
 }
 
-void MySqlConnection::ReleaseConnection(MYSQL* connection) {
-	availableConnections.emplace(connection);
+void MySqlConnection::Retire(MYSQL* connection) {
+	//escaping only needs the charset, keep it for quoting until we go away
+	if (connection == firstSuccessfulConnection)
+		firstConnectionReleased->store(true);
+	else
+		mysql_close(connection);
+}
 
-	if (!firstSuccessfulConnection)
-		firstSuccessfulConnection = connection;
+void MySqlConnection::ReleaseConnection(MYSQL* connection, const unsigned int pool, const unsigned int generation) {
+	auto& target(pools[pool]);
+	if (generation != target.generation)
+		//made or handed out before the server went away
+		Retire(connection);
+	else {
+		target.availableConnections.emplace(connection);
 
-	if (!newestConnectionAttemptKey.empty()) {
+		if (!firstSuccessfulConnection && pool == 0)
+			firstSuccessfulConnection = connection;
+	}
+
+	if (!target.newestConnectionAttemptKey.empty()) {
 		std::string tmp;
-		std::swap(tmp, newestConnectionAttemptKey);
-		if (!GetOperation(tmp)->IsComplete(false))
-			std::swap(tmp, newestConnectionAttemptKey);
+		std::swap(tmp, target.newestConnectionAttemptKey);
+		//gone already if we're tearing down
+		const auto attempt(GetOperation(tmp));
+		if (attempt && !attempt->IsComplete(false))
+			std::swap(tmp, target.newestConnectionAttemptKey);
+	}
+
+	StartPending();
+}
+
+void MySqlConnection::DiscardConnection(MYSQL* connection, const unsigned int pool, const unsigned int generation) {
+	auto& target(pools[pool]);
+	Retire(connection);
+	//a restart or failover takes every idle handle with it, don't make each query find that out on its own
+	if (generation != target.generation)
+		return;
+	++target.generation;
+	while (!target.availableConnections.empty()) {
+		Retire(target.availableConnections.top());
+		target.availableConnections.pop();
+	}
+}
+
+std::string MySqlConnection::ParkingKey(const unsigned int pool) const {
+	const auto& target(pools[pool]);
+	std::string key;
+	for (const auto& I : { target.address, std::to_string(target.port), username, password, database, std::to_string(asyncTimeout), std::string(options.compress ? "1" : "0") + (options.tls ? "1" : "0") + (options.tlsVerify ? "1" : "0"), std::to_string(options.netBufferLength), std::to_string(options.maxAllowedPacket), options.charset, options.tlsCa }) {
+		//lengths first so no two settings can run together into the same key
+		key.append(std::to_string(I.length()));
+		key.append(":");
+		key.append(I);
+	}
+	return key;
+}
+
+void MySqlConnection::Park() {
+	//same as going away, except the idle handles stay open
+	ClearPending();
+	for (auto& I : operations) {
+		auto thread(I.second->GetActiveThread());
+		if (thread)
+			library.RegisterZombieThread(std::move(*thread), I.second->WorkerExited());
 	}
+	{
+		//their destructors hand handles back through ReleaseConnection, which looks at operations
+		const auto dying(std::move(operations));
+		operations.clear();
+	}
+	//the next round resets them on its own workers when it takes them
+	for (auto I(0U); I < pools.size(); ++I) {
+		auto& pool(pools[I]);
+		if (pool.availableConnections.empty() && pool.warmConnections.empty())
+			continue;
+		const auto key(ParkingKey(I));
+		while (!pool.availableConnections.empty()) {
+			const auto front(pool.availableConnections.top());
+			pool.availableConnections.pop();
+			if (front == firstSuccessfulConnection)
+				firstSuccessfulConnection = nullptr;
+			library.ParkConnection(key, front);
+		}
+		while (!pool.warmConnections.empty()) {
+			library.ParkConnection(key, pool.warmConnections.top());
+			pool.warmConnections.pop();
+		}
+	}
+}
+
+std::shared_ptr<Query::Flight> MySqlConnection::FindFlight(const std::string& key) {
+	auto iter(flights.find(key));
+	if (iter == flights.end())
+		return nullptr;
+	return iter->second;
+}
+
+void MySqlConnection::AddFlight(const std::string& key, const std::shared_ptr<Query::Flight>& flight) {
+	//nothing else looks at the ones that landed
+	for (auto I(flights.begin()); I != flights.end();) {
+		if (I->second->Landed())
+			I = flights.erase(I);
+		else
+			++I;
+	}
+	flights[key] = flight;
+}
+
+bool MySqlConnection::SpoolWrite(const std::string& queryText, const bool lastChance) {
+	if (!spool)
+		return false;
+	if (!spool->Append(queryText)) {
+		if (lastChance)
+			spool->Drop();
+		return false;
+	}
+	//the dispatcher may be asleep with nothing else due
+	library.GetDispatcher().Wake();
+	return true;
+}
+
+std::chrono::steady_clock::time_point MySqlConnection::ReplaySpool(const std::chrono::steady_clock::time_point now) {
+	//how long to leave the server after it still couldn't be reached
+	const auto outageBackoff(std::chrono::seconds(1));
+	const auto collectInterval(std::chrono::milliseconds(100));
+	if (!spool || pools.empty())
+		return std::chrono::steady_clock::time_point::max();
+
+	const auto operation(replayKey.empty() ? nullptr : GetOperation(replayKey));
+	if (!operation)
+		replayKey.clear();
+	else {
+		auto& replay(*static_cast<Query*>(operation));
+		for (;;) {
+			if (!replay.IsComplete(false))
+				return now + collectInterval;
+			if (replay.CurrentRow().empty() && !replay.NextResultSet())
+				break;
+		}
+		const auto failed(!replay.GetError().empty());
+		const auto transient(MySqlQueryOperation::IsTransient(replay.GetErrno()));
+		std::string key;
+		std::swap(key, replayKey);
+		ReleaseOperation(key);
+		if (!failed)
+			spool->Pop(true);
+		//it stays at the front so nothing overtakes it
+		else if (transient)
+			nextReplay = now + outageBackoff;
+		//the server turned it down and always will, it can't hold up the rest
+		else
+			spool->Pop(false);
+	}
+
+	std::string queryText;
+	if (now < nextReplay)
+		return spool->Empty() ? std::chrono::steady_clock::time_point::max() : nextReplay;
+	if (!spool->Front(queryText))
+		return std::chrono::steady_clock::time_point::max();
+	//one at a time and no faster than the rate, so a long outage doesn't come back as a burst
+	replayKey = AddQuery(std::make_unique<MySqlQueryOperation>(*this, std::move(queryText), nullptr, false, Bulk, true, false, false, false, false, -1, threadCounter, threadLimit, library.GetDispatcher()), Bulk);
+	nextReplay = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) / spoolRate;
+	return now + collectInterval;
 }
 
 std::string MySqlConnection::Quote(const std::string& str) {
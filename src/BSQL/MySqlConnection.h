@@ -3,30 +3,92 @@
 class MySqlConnectOperation;
 
 class MySqlConnection : public Connection {
+public:
+	//set through OpenConnection, applied to every handle in the pool
+	struct Options {
+		bool compress, tls, tlsVerify, storeResult;
+		//0 leaves the client default
+		unsigned long netBufferLength, maxAllowedPacket;
+		std::string charset, tlsCa;
+		//port 0 uses the primary's
+		std::vector<std::pair<std::string, unsigned short>> replicas;
+		//seconds, 0 skips the check
+		unsigned long replicaMaxLag;
+		//either one makes the thread limit adaptive, 0 leaves that end at 1 or the connection's thread limit
+		unsigned long concurrencyMin, concurrencyMax;
+	};
+private:
+	//one per host, the primary is always first
+	struct Pool {
+		const std::string address;
+		const unsigned short port;
+		std::stack<MYSQL*> availableConnections;
+		//claimed from the last round, the connect operation that takes one resets it first
+		std::stack<MYSQL*> warmConnections;
+		std::string newestConnectionAttemptKey;
+		//bumped when a handle is lost, anything handed out before that isn't trusted back
+		unsigned int generation;
+
+		//replicas only
+		std::chrono::steady_clock::time_point downUntil, lagCheckedAt;
+		std::string lagCheckKey;
+		bool lagging;
+
+		Pool(const std::string& address, const unsigned short port);
+	};
 private:
-	std::string address;
 	std::string username;
 	std::string password;
 	std::string database;
+	Options options;
 
-	std::stack<MYSQL*> availableConnections;
+	std::vector<Pool> pools;
+	unsigned int nextReplica;
 	MYSQL* firstSuccessfulConnection;
-	std::string newestConnectionAttemptKey;
+	//an abandoned query may still be using firstSuccessfulConnection when we go away, whichever of us lets go second closes it
+	const std::shared_ptr<std::atomic_bool> firstConnectionReleased;
 
-	std::atomic_uint_fast32_t threadCounter;
+	//shared reads with a worker running, keyed by where they may go and their text
+	std::map<std::string, std::shared_ptr<Query::Flight>> flights;
 
-	const unsigned int asyncTimeout, threadLimit;
-	unsigned short port;
+	const std::shared_ptr<std::atomic_uint_fast32_t> threadCounter;
+
+	const unsigned int asyncTimeout;
+
+	//statements per second sent from the spool
+	unsigned long spoolRate;
+	//the spooled statement being sent, empty between them
+	std::string replayKey;
+	std::chrono::steady_clock::time_point nextReplay;
 private:
-	bool LoadNewConnection(std::string& fail, int& failno);
+	bool LoadNewConnection(const unsigned int pool, std::string& fail, int& failno);
+	//a parked handle only suits a connection that would have made it the same way
+	std::string ParkingKey(const unsigned int pool) const;
+	void Retire(MYSQL* connection);
+	void CheckLag(const unsigned int pool);
+	//0 if no replica can take it
+	unsigned int PickReplica();
 public:
 	MySqlConnection(Library& library, const unsigned int asyncTimeout, const unsigned int blockingTimeout, const unsigned int threadLimit);
 	~MySqlConnection() override;
 
+	std::string Configure(const std::map<std::string, std::string>& newOptions) override;
 	std::string Connect(const std::string& address, const unsigned short port, const std::string& username, const std::string& password, const std::string& database) override;
-	std::string CreateQuery(const std::string& queryText) override;
+	std::string CreateQuery(const std::string& queryText, const Priority priority, const unsigned int flags, std::unique_ptr<ExportFile>&& exportFile, const bool reclaimable) override;
 	std::string Quote(const std::string& str) override;
+	std::string Explain(const std::string& queryText) override;
+	void Park() override;
+	std::chrono::steady_clock::time_point ReplaySpool(const std::chrono::steady_clock::time_point now) override;
+
+	//pinnedPool < 0 lets replicaSafe queries go to a replica, pool and generation are set to what the handle must be returned with
+	MYSQL* RequestConnection(const bool replicaSafe, const int pinnedPool, unsigned int& pool, unsigned int& generation, std::string& fail, int& failno, std::shared_ptr<std::atomic_bool>& sharedRelease);
+	void ReleaseConnection(MYSQL* connection, const unsigned int pool, const unsigned int generation);
+	//for handles that lost the server, drops every idle handle of the same generation with it
+	void DiscardConnection(MYSQL* connection, const unsigned int pool, const unsigned int generation);
 
-	MYSQL* RequestConnection(std::string& fail, int& failno, bool& doNotClose);
-	void ReleaseConnection(MYSQL* connection);
+	//null if nothing with that key has been started, it may still have landed since
+	std::shared_ptr<Query::Flight> FindFlight(const std::string& key);
+	void AddFlight(const std::string& key, const std::shared_ptr<Query::Flight>& flight);
+	//false if there's no spool or it can't take the statement, lastChance counts it as dropped then
+	bool SpoolWrite(const std::string& queryText, const bool lastChance);
 };
\ No newline at end of file
@@ -1,82 +1,266 @@
 #include "BSQL.h"
 
-MySqlQueryOperation::MySqlQueryOperation(MySqlConnection& connPool, std::string&& queryText, std::atomic_uint_fast32_t& threadCounter, const unsigned int threadLimit) :
+//the handle is dead rather than the query being wrong
+static bool IsConnectionLost(const int errnum) {
+	switch (errnum) {
+	case 1053:	//ER_SERVER_SHUTDOWN
+	case 1927:	//ER_CONNECTION_KILLED
+	case 2006:	//CR_SERVER_GONE_ERROR
+	case 2013:	//CR_SERVER_LOST
+	case 2055:	//CR_SERVER_LOST_EXTENDED
+		return true;
+	default:
+		return false;
+	}
+}
+
+//nothing got through to the server, or it got cut off
+static bool IsUnreachable(const int errnum) {
+	switch (errnum) {
+	case 2002:	//CR_CONNECTION_ERROR
+	case 2003:	//CR_CONN_HOST_ERROR
+	case 2005:	//CR_UNKNOWN_HOST
+		return true;
+	default:
+		return IsConnectionLost(errnum);
+	}
+}
+
+//the server is struggling rather than the query being wrong, the concurrency limit backs off for these
+static bool IsOverloaded(const int errnum) {
+	switch (errnum) {
+	case 1040:	//ER_CON_COUNT_ERROR
+	case 1203:	//ER_TOO_MANY_USER_CONNECTIONS
+	case 1205:	//ER_LOCK_WAIT_TIMEOUT
+	case 1969:	//ER_STATEMENT_TIMEOUT
+	case 3024:	//ER_QUERY_TIMEOUT
+		return true;
+	default:
+		return IsConnectionLost(errnum);
+	}
+}
+
+MySqlQueryOperation::MySqlQueryOperation(MySqlConnection& connPool, std::string&& queryText, std::unique_ptr<ExportFile>&& exportFile, const bool chunked, const Connection::Priority priority, const bool storeResult, const bool replicaSafe, const bool retryable, const bool shared, const bool deferrable, const int pinnedPool, const std::shared_ptr<std::atomic_uint_fast32_t>& threadCounter, ConcurrencyLimit& threadLimit, Dispatcher& dispatcher) :
+	Query(connPool, std::make_shared<MySqlResultState>()),
 	queryText(std::move(queryText)),
+	priority(priority),
+	storeResult(storeResult),
+	replicaSafe(replicaSafe),
+	retryable(retryable),
+	shared(shared),
+	deferrable(deferrable),
+	pinnedPool(pinnedPool),
 	connPool(connPool),
 	connection(nullptr),
-	state(std::make_shared<ClassState>()),
+	pool(0),
+	generation(0),
 	connectionAttempts(0),
-	started(false),
-	complete(false),
+	retries(0),
+	retrying(false),
 	threadCounter(threadCounter),
 	threadLimit(threadLimit),
-	operationThread(TryStart())
+	dispatcher(dispatcher)
 {
+	state->exportFile = std::move(exportFile);
+	state->chunked = chunked;
 }
 
 MySqlQueryOperation::~MySqlQueryOperation() {
 	if (!connection)
 		return;
-	connPool.ReleaseConnection(connection);
+	//a worker that lost the server has finished by now, or the connection would have gone with it
+	if (started && IsConnectionLost(state->errnum))
+		connPool.DiscardConnection(connection, pool, generation);
+	else
+		connPool.ReleaseConnection(connection, pool, generation);
 }
 
-std::thread MySqlQueryOperation::TryStart() {
+bool MySqlQueryOperation::TryStart() {
+	std::string flightKey;
+	if (shared) {
+		flightKey = replicaSafe ? "replica:" : "primary:";
+		flightKey.append(queryText);
+		//joining costs neither a thread nor a connection
+		const auto flight(connPool.FindFlight(flightKey));
+		if (flight && flight->Join(state)) {
+			started = true;
+			return true;
+		}
+	}
+
+	//check for a slot first so we don't sit on a pooled connection we can't use
+	if (*threadCounter > threadLimit.Current())
+		return false;
 	if (!connection) {
-		connection = connPool.RequestConnection(error, errnum, noClose);
+		connection = connPool.RequestConnection(replicaSafe, pinnedPool, pool, generation, error, errnum, sharedRelease);
 		if (!connection) {
-			if (!error.empty())
-				complete = ++connectionAttempts == 3;
-			return std::thread();
+			if (!error.empty() && ++connectionAttempts == 3) {
+				complete = true;
+				Defer();
+			}
+			return complete;
 		}
 	}
-	if (threadCounter.fetch_add(1) > threadLimit) {
-		--threadCounter;
-		return std::thread();
+	if (shared) {
+		auto flight(std::make_shared<Flight>());
+		flight->Join(state);
+		connPool.AddFlight(flightKey, flight);
+		static_cast<MySqlResultState&>(*state).flight = std::move(flight);
 	}
+	++*threadCounter;
 	started = true;
-	return std::thread(&MySqlQueryOperation::StartQuery, this, connection, std::move(queryText), state);
+	startedAt = std::chrono::steady_clock::now();
+	//keep ours if it may have to be sent again or spooled
+	std::string text;
+	if (retryable || deferrable)
+		text = queryText;
+	else
+		text = std::move(queryText);
+	operationThread = std::thread(&MySqlQueryOperation::StartQuery, connection, std::move(text), storeResult, sharedRelease, threadCounter, std::ref(dispatcher), std::static_pointer_cast<MySqlResultState>(state), NewWorkerFlag());
+	return true;
 }
 
-void MySqlQueryOperation::QuestionableExit(MYSQL* mysql, std::shared_ptr<ClassState>& localClassState) {
-	//resultless?
-	localClassState->lock.lock();
-	if (localClassState->alive) {
-		complete = true;
-		const auto tmpErr(mysql_errno(mysql));
-		if (tmpErr) {
-			//no it's an error
-			error = mysql_error(mysql);
-			errnum = tmpErr;
-		}
+bool MySqlQueryOperation::Retry() {
+	//doubles each time, gives a restart or failover a moment to settle
+	const auto retryBackoff(std::chrono::milliseconds(100));
+	const auto maxRetries(3);
+
+	if (!connection || !IsConnectionLost(errnum))
+		return false;
+	connPool.DiscardConnection(connection, pool, generation);
+	connection = nullptr;
+
+	auto& localState(static_cast<MySqlResultState&>(*state));
+	//DM already has some of the rows or it might not be safe to run twice
+	if (!retryable || !localState.lostEarly || retries == maxRetries)
+		return false;
+
+	//the worker is done with the state, reset it for the next one
+	operationThread.join();
+	error = std::string();
+	errnum = 0;
+	localState.error = std::string();
+	localState.errnum = 0;
+	localState.affectedRows = 0;
+	localState.insertId = 0;
+	localState.warnings = 0;
+	localState.blobs.clear();
+	localState.lostEarly = false;
+	localState.status.store(ResultState::Running, std::memory_order_relaxed);
+	started = false;
+	complete = false;
+	retrying = true;
+	retryAt = std::chrono::steady_clock::now() + retryBackoff * (1 << retries++);
+	return true;
+}
+
+void MySqlQueryOperation::Defer() {
+	//a write that can wait does so on disk rather than failing
+	if (deferrable && IsUnreachable(errnum) && connPool.SpoolWrite(queryText, true))
+		MarkSpooled();
+}
+
+bool MySqlQueryOperation::IsComplete(bool noSkip) {
+	if (retrying) {
+		if (std::chrono::steady_clock::now() < retryAt)
+			return false;
+		retrying = false;
+		connPool.Requeue(*this, priority);
 	}
-	else if (!noClose)
+	const auto wasComplete(complete);
+	const auto result(Query::IsComplete(noSkip));
+	if (!complete || wasComplete)
+		return result;
+	//only what ran on a worker of our own says anything about the server, counting ourselves as still in flight
+	const auto ownWorker(started && connection);
+	if (ownWorker)
+		threadLimit.Sample(state->finishedAt - startedAt, static_cast<unsigned int>(*threadCounter) + 1, IsOverloaded(errnum));
+	if (Retry())
+		return false;
+	if (ownWorker)
+		RecordDigest();
+	Defer();
+	return result;
+}
+
+bool MySqlQueryOperation::IsTransient(const int errnum) {
+	return IsUnreachable(errnum) || IsOverloaded(errnum);
+}
+
+void MySqlQueryOperation::Abandoned(MYSQL* mysql, const std::shared_ptr<std::atomic_bool>& localSharedRelease) {
+	//nobody will return this to the pool, but the pool may still be using it for quoting
+	if (!localSharedRelease || localSharedRelease->exchange(true))
 		mysql_close(mysql);
+}
+
+void MySqlQueryOperation::QuestionableExit(MYSQL* mysql, const bool handedOver, const std::shared_ptr<std::atomic_bool>& localSharedRelease, std::atomic_uint_fast32_t& localThreadCounter, Dispatcher& localDispatcher, MySqlResultState& localState) {
+	//resultless?
+	const auto tmpErr(mysql_errno(mysql));
+	if (tmpErr) {
+		//no it's an error
+		localState.error = mysql_error(mysql);
+		localState.errnum = tmpErr;
+		localState.lostEarly = !handedOver && IsConnectionLost(tmpErr);
+	}
+	localState.finishedAt = std::chrono::steady_clock::now();
+	if (localState.flight)
+		localState.flight->Land(localState);
+	if (!localState.Finish())
+		Abandoned(mysql, localSharedRelease);
 	mysql_thread_end();
-	localClassState->lock.unlock();
-	--threadCounter;
+	--localThreadCounter;
+	localDispatcher.Wake();
 }
 
-void MySqlQueryOperation::StartQuery(MYSQL* mysql, std::string&& localQueryText, std::shared_ptr<ClassState> localClassState) {
-	mysql_thread_init();
+void MySqlQueryOperation::ExportRows(MYSQL* mysql, MYSQL_RES* result, ExportFile& exportFile, ResultState& localState) {
+	try {
+		const auto numFields(mysql_num_fields(result));
+		const auto fields(mysql_fetch_fields(result));
+		std::vector<std::string> names;
+		for (auto I(0U); I < numFields; ++I)
+			names.emplace_back(fields[I].name);
 
-	const auto localError(mysql_real_query(mysql, localQueryText.c_str(), localQueryText.length()));
+		auto written(exportFile.Begin(std::move(names)));
+		for (MYSQL_ROW row(written ? mysql_fetch_row(result) : nullptr); row != nullptr && !localState.IsAbandoned(); row = mysql_fetch_row(result))
+			if (!(written = exportFile.WriteRow(row, mysql_fetch_lengths(result))))
+				break;
+		written = exportFile.End() && written;
 
-	if (localError) {
-		QuestionableExit(mysql, localClassState);
-		return;
+		if (!written) {
+			localState.error = exportFile.GetError();
+			localState.errnum = -1;
+		}
+		//a fetch that failed part way is reported by the caller, and may be retried into the same file
+		else if (!mysql_errno(mysql))
+			localState.results.Push(exportFile.Summary());
 	}
-
-	const auto result(mysql_use_result(mysql));
-	if (!result) {
-		QuestionableExit(mysql, localClassState);
-		return;
+	catch (std::bad_alloc&) {
+		localState.errnum = -1;
+		localState.error = "Out of memory!";
 	}
+}
 
-	for (MYSQL_ROW row(mysql_fetch_row(result)); row != nullptr; row = mysql_fetch_row(result)) {
-		try {
+bool MySqlQueryOperation::PushRow(std::string&& row, MySqlResultState& localState) {
+	if (localState.flight)
+		return localState.flight->Push(std::move(row));
+	if (localState.IsAbandoned())
+		return false;
+	localState.results.Push(std::move(row));
+	return true;
+}
+
+bool MySqlQueryOperation::PushRows(MYSQL_RES* result, const bool newSet, bool& handedOver, MySqlResultState& localState) {
+	try {
+		if (newSet) {
+			if (!PushRow(std::string(), localState))
+				return false;
+			handedOver = true;
+		}
+		for (MYSQL_ROW row(mysql_fetch_row(result)); row != nullptr; row = mysql_fetch_row(result)) {
 			std::string json("{");
 			bool first(true);
 			const auto numFields(mysql_num_fields(result));
+			const auto lengths(mysql_fetch_lengths(result));
 			mysql_field_seek(result, 0);
 			for (auto I(0U); I < numFields; ++I) {
 				const auto field(mysql_fetch_field(result));
@@ -90,81 +274,79 @@ void MySqlQueryOperation::StartQuery(MYSQL* mysql, std::string&& localQueryText,
 				json.append("\":");
 				if (row[I] == nullptr)
 					json.append("null");
-				else {
-					json.append("\"");
-					json.append(Library::EscapeJsonString(row[I]));
-					json.append("\"");
-				}
+				else
+					AppendValue(json, row[I], lengths[I], localState);
 			}
 			json.append("}");
 
-			localClassState->lock.lock();
-			const auto alive(localClassState->alive);
-			if (alive)
-				results.emplace(std::move(json));
-			localClassState->lock.unlock();
-			if (!alive)
-				break;
-		}
-		catch (std::bad_alloc&) {
-			mysql_free_result(result);
-			localClassState->lock.lock();
-			if (localClassState->alive) {
-				complete = true;
-				errnum = -1;
-				error = "Out of memory!";
-			}
-			else if (!noClose)
-				mysql_close(mysql);
-			mysql_thread_end();
-			localClassState->lock.unlock();
-			--threadCounter;
-			return;
+			if (!PushRow(std::move(json), localState))
+				return false;
+			handedOver = true;
 		}
+		return true;
 	}
-
-	mysql_free_result(result);
-
-	QuestionableExit(mysql, localClassState);
-}
-
-bool MySqlQueryOperation::IsComplete(bool noSkip) {
-	if (!started) {
-		operationThread = TryStart();
+	catch (std::bad_alloc&) {
+		localState.errnum = -1;
+		localState.error = "Out of memory!";
 		return false;
 	}
+}
+
+void MySqlQueryOperation::StartQuery(MYSQL* mysql, std::string localQueryText, const bool localStoreResult, std::shared_ptr<std::atomic_bool> localSharedRelease, std::shared_ptr<std::atomic_uint_fast32_t> localThreadCounter, Dispatcher& localDispatcher, std::shared_ptr<MySqlResultState> localState, std::shared_ptr<std::atomic_bool> localExited) {
+	const ExitGuard exitGuard(localExited);
+	mysql_thread_init();
 
-	state->lock.lock();
-	if (!results.empty()) {
-		if (!noSkip) {
-			currentRow = std::move(results.front());
-			results.pop();
+	auto handedOver(false), discard(false);
+	auto resultSets(0U);
+	//a CALL can return any number of result sets, everything has to be read off before the connection can be used again
+	for (auto status(mysql_real_query(mysql, localQueryText.c_str(), localQueryText.length())); status == 0; status = mysql_next_result(mysql)) {
+		//storing frees the server side of the result before we start building rows
+		const auto result(localStoreResult ? mysql_store_result(mysql) : mysql_use_result(mysql));
+		if (!result) {
+			//an error, or a statement without a result set like the status a CALL ends with
+			if (mysql_field_count(mysql) != 0)
+				break;
+			//a CALL reports what its last statement changed
+			localState->affectedRows = mysql_affected_rows(mysql);
+			if (mysql_insert_id(mysql) != 0)
+				localState->insertId = mysql_insert_id(mysql);
+			localState->warnings += mysql_warning_count(mysql);
+			continue;
 		}
-		state->lock.unlock();
-		return true;
+
+		//after being abandoned, running out of memory, or filling the export file the rest is only read off
+		if (!discard) {
+			if (localState->exportFile) {
+				ExportRows(mysql, result, *localState->exportFile, *localState);
+				discard = true;
+			}
+			else
+				discard = !PushRows(result, resultSets > 0, handedOver, *localState);
+		}
+		++resultSets;
+		mysql_free_result(result);
+		//only counted once the rows have all been read
+		localState->warnings += mysql_warning_count(mysql);
 	}
 
-	const auto result(complete);
-	state->lock.unlock();
-	if (result && !noSkip)
-		currentRow = std::string();
-	return result;
+	QuestionableExit(mysql, handedOver, localSharedRelease, *localThreadCounter, localDispatcher, *localState);
 }
 
 std::thread* MySqlQueryOperation::GetActiveThread() {
 	if (!started)
 		return nullptr;
 
-	state->lock.lock();
+	//joined someone else's worker, let it know to skip us
+	if (!operationThread.joinable()) {
+		state->Abandon();
+		return nullptr;
+	}
 
-	if (complete) {
-		state->lock.unlock();
+	if (!state->Abandon()) {
 		operationThread.join();
 		return nullptr;
 	}
 
-	state->alive = false;
-	state->lock.unlock();
 	connection = nullptr;
 	return &operationThread;
 }
@@ -1,27 +1,53 @@
 #pragma once
 
 class MySqlQueryOperation : public Query {
+private:
+	struct MySqlResultState : public ResultState {
+		//the server went away before any rows were handed over, only valid to read after seeing Complete
+		bool lostEarly = false;
+		//set before the worker starts on a shared read, rows go to everyone in it
+		std::shared_ptr<Flight> flight;
+	};
 private:
 	std::string queryText;
+	const Connection::Priority priority;
+	//retryable queries are plain reads that can be sent again after a lost connection, shared ones join an identical read that's already running, deferrable ones go to the spool if the server can't be reached
+	const bool storeResult, replicaSafe, retryable, shared, deferrable;
+	const int pinnedPool;
 	MySqlConnection& connPool;
 	MYSQL* connection;
-	bool noClose;
-	std::shared_ptr<ClassState> state;
-	std::queue<std::string> results;
-	int connectionAttempts;
-	bool started, complete;
-	std::atomic_uint_fast32_t& threadCounter;
-	const unsigned int threadLimit;
+	unsigned int pool, generation;
+	std::shared_ptr<std::atomic_bool> sharedRelease;
+	int connectionAttempts, retries;
+	//waiting out the backoff, not in any queue until then
+	bool retrying;
+	std::chrono::steady_clock::time_point retryAt;
+	const std::shared_ptr<std::atomic_uint_fast32_t> threadCounter;
+	ConcurrencyLimit& threadLimit;
+	Dispatcher& dispatcher;
 	std::thread operationThread;
 private:
-	std::thread TryStart();
+	//these run on the worker and can't touch the operation, it may be gone
+	static void Abandoned(MYSQL* mysql, const std::shared_ptr<std::atomic_bool>& localSharedRelease);
+	static void QuestionableExit(MYSQL* mysql, const bool handedOver, const std::shared_ptr<std::atomic_bool>& localSharedRelease, std::atomic_uint_fast32_t& localThreadCounter, Dispatcher& localDispatcher, MySqlResultState& localState);
+	//false if the rest of the results should be thrown away
+	static bool PushRows(MYSQL_RES* result, const bool newSet, bool& handedOver, MySqlResultState& localState);
+	static bool PushRow(std::string&& row, MySqlResultState& localState);
+	static void ExportRows(MYSQL* mysql, MYSQL_RES* result, ExportFile& exportFile, ResultState& localState);
+	static void StartQuery(MYSQL* mysql, std::string localQueryText, const bool localStoreResult, std::shared_ptr<std::atomic_bool> localSharedRelease, std::shared_ptr<std::atomic_uint_fast32_t> localThreadCounter, Dispatcher& localDispatcher, std::shared_ptr<MySqlResultState> localState, std::shared_ptr<std::atomic_bool> localExited);
 
-	void QuestionableExit(MYSQL* mysql, std::shared_ptr<ClassState>& localClassState);
-	void StartQuery(MYSQL* mysql, std::string&& localQueryText, std::shared_ptr<ClassState> localClassState);
+	//game thread side once the query completes, hands back a dead connection and schedules another go if that's safe
+	bool Retry();
+	//game thread side once the query fails for good, a deferrable write that couldn't reach the server completes from the spool instead
+	void Defer();
 public:
-	MySqlQueryOperation(MySqlConnection& connPool, std::string&& queryText, std::atomic_uint_fast32_t& threadCounter, const unsigned int threadLimit);
+	MySqlQueryOperation(MySqlConnection& connPool, std::string&& queryText, std::unique_ptr<ExportFile>&& exportFile, const bool chunked, const Connection::Priority priority, const bool storeResult, const bool replicaSafe, const bool retryable, const bool shared, const bool deferrable, const int pinnedPool, const std::shared_ptr<std::atomic_uint_fast32_t>& threadCounter, ConcurrencyLimit& threadLimit, Dispatcher& dispatcher);
 	~MySqlQueryOperation() override;
 
+	//the query isn't at fault and may go through if it's sent again later
+	static bool IsTransient(const int errnum);
+
+	bool TryStart() override;
 	bool IsComplete(bool noSkip) override;
 	std::thread* GetActiveThread() override;
 };
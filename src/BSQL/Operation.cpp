@@ -1,5 +1,35 @@
 #include "BSQL.h"
 
+Operation::ExitGuard::ExitGuard(const std::shared_ptr<std::atomic_bool>& exited) :
+	exited(exited)
+{}
+
+Operation::ExitGuard::~ExitGuard() {
+	*exited = true;
+}
+
+Operation::Operation() :
+	lastUsed(std::chrono::steady_clock::now())
+{}
+
+void Operation::Touch() {
+	lastUsed = std::chrono::steady_clock::now();
+}
+
+std::chrono::steady_clock::time_point Operation::LastUsed() const {
+	return lastUsed;
+}
+
+std::shared_ptr<std::atomic_bool> Operation::NewWorkerFlag() {
+	//a worker that's started again gets a new one, the old one is already set
+	workerExited = std::make_shared<std::atomic_bool>(false);
+	return workerExited;
+}
+
+std::shared_ptr<std::atomic_bool> Operation::WorkerExited() const {
+	return workerExited;
+}
+
 std::string Operation::GetError() {
 	if (!IsComplete(true))
 		return std::string();
@@ -7,12 +7,34 @@ protected:
 		std::mutex lock;
 		bool alive = true;
 	};
+	//held by a worker for its whole run so a zombie can be joined once it's done without waiting on it
+	class ExitGuard {
+	private:
+		const std::shared_ptr<std::atomic_bool> exited;
+	public:
+		ExitGuard(const std::shared_ptr<std::atomic_bool>& exited);
+		ExitGuard(const ExitGuard&) = delete;
+		ExitGuard(ExitGuard&&) = delete;
+		~ExitGuard();
+	};
 protected:
 	int errnum;
 	std::string error;
+private:
+	std::chrono::steady_clock::time_point lastUsed;
+	//of the last worker started
+	std::shared_ptr<std::atomic_bool> workerExited;
+protected:
+	//for the ExitGuard of a worker about to be started
+	std::shared_ptr<std::atomic_bool> NewWorkerFlag();
 public:
+	Operation();
 	virtual ~Operation() = default;
 
+	//someone looked it up
+	void Touch();
+	std::chrono::steady_clock::time_point LastUsed() const;
+
 	std::string GetError();
 	std::string GetErrorCode();
 	int GetErrno();
@@ -20,4 +42,6 @@ public:
 	virtual bool IsComplete(bool noSkip) = 0;
 	virtual bool IsQuery() = 0;
 	virtual std::thread* GetActiveThread() = 0;
+	//set once the thread GetActiveThread hands over is done, null if none was ever started
+	std::shared_ptr<std::atomic_bool> WorkerExited() const;
 };
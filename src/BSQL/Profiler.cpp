@@ -0,0 +1,88 @@
+#include "BSQL.h"
+
+Profiler::Entry::Entry(const char* const name) :
+	name(name),
+	calls(0),
+	bytes(0),
+	totalTime(std::chrono::steady_clock::duration::zero()),
+	maxTime(std::chrono::steady_clock::duration::zero())
+{}
+
+Profiler::Profiler() :
+	enabled(false),
+	windowStart(std::chrono::steady_clock::now())
+{}
+
+void Profiler::Reset() {
+	for (auto& I : entries) {
+		I.calls = 0;
+		I.bytes = 0;
+		I.totalTime = std::chrono::steady_clock::duration::zero();
+		I.maxTime = std::chrono::steady_clock::duration::zero();
+	}
+	windowStart = std::chrono::steady_clock::now();
+}
+
+Profiler::Entry& Profiler::Register(const char* const name) {
+	std::lock_guard<std::mutex> guard(lock);
+	entries.emplace_back(name);
+	return entries.back();
+}
+
+const char* Profiler::Record(Entry& entry, const Export call, const int argumentCount, const char* const* const args) {
+	if (!enabled.load(std::memory_order_relaxed))
+		return call(argumentCount, args);
+
+	const auto start(std::chrono::steady_clock::now());
+	const auto result(call(argumentCount, args));
+	const auto elapsed(std::chrono::steady_clock::now() - start);
+	const auto bytes(result ? std::strlen(result) : 0);
+
+	std::lock_guard<std::mutex> guard(lock);
+	++entry.calls;
+	entry.bytes += bytes;
+	entry.totalTime += elapsed;
+	entry.maxTime = std::max(entry.maxTime, elapsed);
+	return result;
+}
+
+void Profiler::Start() {
+	std::lock_guard<std::mutex> guard(lock);
+	Reset();
+	enabled = true;
+}
+
+void Profiler::Stop() {
+	enabled = false;
+}
+
+std::string Profiler::GetStats(const bool reset) {
+	std::lock_guard<std::mutex> guard(lock);
+	std::string json("{\"windowMs\":");
+	json.append(std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - windowStart).count()));
+	json.append(",\"calls\":{");
+	auto first(true);
+	for (const auto& I : entries) {
+		if (I.calls == 0)
+			continue;
+		if (first)
+			first = false;
+		else
+			json.append(",");
+		json.append("\"");
+		json.append(I.name);
+		json.append("\":{\"calls\":");
+		json.append(std::to_string(I.calls));
+		json.append(",\"totalUs\":");
+		json.append(std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(I.totalTime).count()));
+		json.append(",\"maxUs\":");
+		json.append(std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(I.maxTime).count()));
+		json.append(",\"bytes\":");
+		json.append(std::to_string(I.bytes));
+		json.append("}");
+	}
+	json.append("}}");
+	if (reset)
+		Reset();
+	return json;
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+//Time spent inside each export, measured around the call so it's what DM actually waits on. Costs one relaxed load per call while stopped
+class Profiler {
+public:
+	typedef const char* (*Export)(const int argumentCount, const char* const* const args);
+	struct Entry {
+		const char* const name;
+		unsigned long long calls, bytes;
+		std::chrono::steady_clock::duration totalTime, maxTime;
+
+		Entry(const char* const name);
+	};
+private:
+	std::atomic_bool enabled;
+	std::mutex lock;
+	//never removed from so the references Register hands out stay good
+	std::deque<Entry> entries;
+	std::chrono::steady_clock::time_point windowStart;
+private:
+	void Reset();
+public:
+	Profiler();
+	Profiler(const Profiler&) = delete;
+	Profiler(Profiler&&) = delete;
+
+	//once per export, before its first call
+	Entry& Register(const char* const name);
+	const char* Record(Entry& entry, const Export call, const int argumentCount, const char* const* const args);
+
+	//clears what was recorded so far
+	void Start();
+	void Stop();
+	//{"windowMs":N,"calls":{"Name":{"calls":N,"totalUs":N,"maxUs":N,"bytes":N},...}} for the exports called since the window started, a reset starts the next one
+	std::string GetStats(const bool reset);
+};
\ No newline at end of file
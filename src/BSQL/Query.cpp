@@ -1,9 +1,250 @@
 #include "BSQL.h"
 
+Query::ResultState::ResultState() :
+	status(Running),
+	errnum(0),
+	affectedRows(0),
+	insertId(0),
+	warnings(0),
+	chunked(false)
+{}
+
+bool Query::ResultState::Finish() {
+	auto expected(static_cast<int>(Running));
+	return status.compare_exchange_strong(expected, Complete, std::memory_order_acq_rel);
+}
+
+bool Query::ResultState::IsAbandoned() {
+	return status.load(std::memory_order_relaxed) == Abandoned;
+}
+
+bool Query::ResultState::Abandon() {
+	auto expected(static_cast<int>(Running));
+	return status.compare_exchange_strong(expected, Abandoned, std::memory_order_acq_rel);
+}
+
+Query::Flight::Flight() :
+	landed(false)
+{}
+
+bool Query::Flight::Join(const std::shared_ptr<ResultState>& reader) {
+	std::lock_guard<std::mutex> guard(lock);
+	if (landed)
+		return false;
+	for (const auto& I : history)
+		reader->results.Push(std::string(I));
+	readers.emplace_back(reader);
+	return true;
+}
+
+bool Query::Flight::Landed() {
+	std::lock_guard<std::mutex> guard(lock);
+	return landed;
+}
+
+bool Query::Flight::Push(std::string&& row) {
+	std::lock_guard<std::mutex> guard(lock);
+	auto listening(false);
+	for (const auto& I : readers)
+		if (!I->IsAbandoned()) {
+			I->results.Push(std::string(row));
+			listening = true;
+		}
+	if (!listening) {
+		//the rest won't be read, anyone who comes along now has to start over
+		landed = true;
+		return false;
+	}
+	history.emplace_back(std::move(row));
+	return true;
+}
+
+void Query::Flight::Land(const ResultState& result) {
+	std::lock_guard<std::mutex> guard(lock);
+	landed = true;
+	std::vector<std::string>().swap(history);
+	for (const auto& I : readers)
+		if (I.get() != &result) {
+			I->error = result.error;
+			I->errnum = result.errnum;
+			I->warnings = result.warnings;
+			I->finishedAt = result.finishedAt;
+			I->Finish();
+		}
+	readers.clear();
+}
+
+Query::Query(Connection& owner, std::shared_ptr<ResultState>&& state) :
+	owner(owner),
+	state(std::move(state)),
+	resultSet(0),
+	setEnded(false),
+	started(false),
+	complete(false),
+	affectedRows(0),
+	insertId(0),
+	warnings(0),
+	rowsRead(0),
+	reclaimable(false),
+	spooled(false)
+{}
+
+void Query::AppendValue(std::string& json, const char* const value, const size_t length, ResultState& localState) {
+	if (!localState.chunked || length <= ChunkThreshold) {
+		json.append("\"");
+		json.append(Library::EscapeJsonString(std::string(value, length)));
+		json.append("\"");
+		return;
+	}
+	//kept raw, only the pieces DM asks for are ever escaped
+	std::lock_guard<std::mutex> guard(localState.blobLock);
+	json.append("{\"blob\":" + std::to_string(localState.blobs.size()) + ",\"length\":" + std::to_string(length) + "}");
+	localState.blobs.emplace_back(value, length);
+}
+
+bool Query::IsComplete(bool noSkip) {
+	if (!started) {
+		//queued behind others, give the connection a chance to start whatever should go next
+		owner.StartPending();
+		if (!started) {
+			//failed before it could start
+			if (complete && !noSkip)
+				currentRow = std::string();
+			return complete;
+		}
+	}
+
+	return ReadResults(noSkip);
+}
+
+bool Query::ReadResults(bool noSkip) {
+	if (setEnded) {
+		if (!noSkip)
+			currentRow = std::string();
+		return true;
+	}
+
+	const auto takeRow([&]() {
+		if (noSkip)
+			return !state->results.Empty();
+		if (!state->results.Pop(currentRow))
+			return false;
+		setEnded = currentRow.empty();
+		if (!setEnded)
+			++rowsRead;
+		return true;
+	});
+
+	if (takeRow())
+		return true;
+
+	if (!complete) {
+		if (state->status.load(std::memory_order_acquire) != ResultState::Complete)
+			return false;
+		error = state->error;
+		errnum = state->errnum;
+		affectedRows = state->affectedRows;
+		insertId = state->insertId;
+		warnings = state->warnings;
+		complete = true;
+		//rows pushed between the first check and the status load
+		if (takeRow())
+			return true;
+	}
+
+	if (!noSkip)
+		currentRow = std::string();
+	return true;
+}
+
+void Query::RecordDigest() {
+	if (digestText.empty())
+		return;
+	owner.RecordDigest(std::move(digestText), state->finishedAt - startedAt, rowsRead, !error.empty());
+	digestText.clear();
+}
+
+void Query::Reject(std::string&& message, const int code) {
+	error = std::move(message);
+	errnum = code;
+	complete = true;
+}
+
+void Query::MarkSpooled() {
+	error = std::string();
+	errnum = 0;
+	spooled = true;
+	complete = true;
+}
+
+void Query::TrackDigest(const std::string& queryText) {
+	digestText = queryText;
+}
+
+void Query::SetReclaimable() {
+	reclaimable = true;
+}
+
+bool Query::Reclaimable() const {
+	//one waiting to start or to be retried isn't done yet
+	return reclaimable && (complete || (started && state->status.load(std::memory_order_acquire) == ResultState::Complete));
+}
+
+std::chrono::steady_clock::time_point Query::IdleSince() const {
+	//one that never had a worker of its own has no finishedAt
+	return std::max(LastUsed(), state->finishedAt);
+}
+
+size_t Query::BufferedBytes() const {
+	auto bytes(currentRow.length() + state->results.Bytes());
+	std::lock_guard<std::mutex> guard(state->blobLock);
+	for (const auto& I : state->blobs)
+		bytes += I.length();
+	return bytes;
+}
+
 std::string Query::CurrentRow() const {
 	return currentRow;
 }
 
+unsigned int Query::CurrentResultSet() const {
+	return resultSet;
+}
+
+bool Query::NextResultSet() {
+	if (!setEnded)
+		return false;
+	setEnded = false;
+	++resultSet;
+	return true;
+}
+
+std::string Query::Info() const {
+	if (!complete)
+		return std::string();
+	return "{\"affectedRows\":" + std::to_string(affectedRows) + ",\"insertId\":" + std::to_string(insertId) + ",\"warnings\":" + std::to_string(warnings) + ",\"spooled\":" + (spooled ? "1" : "0") + "}";
+}
+
+std::string Query::ReadChunk(const size_t blob, const size_t offset, const size_t length) const {
+	std::lock_guard<std::mutex> guard(state->blobLock);
+	if (blob >= state->blobs.size())
+		return std::string();
+	const auto& value(state->blobs[blob]);
+	const auto start(std::min(offset, value.length()));
+	auto end(value.length());
+	if (end - start > length)
+		end = start + length;
+	if (end - start > ChunkLimit)
+		end = start + ChunkLimit;
+	//don't split a UTF-8 character between chunks unless it's bigger than the chunk
+	auto boundary(end);
+	while (boundary > start && boundary < value.length() && (value[boundary] & 0xC0) == 0x80)
+		--boundary;
+	if (boundary > start)
+		end = boundary;
+	return "{\"data\":\"" + Library::EscapeJsonString(value.substr(start, end - start)) + "\",\"next\":" + (end < value.length() ? std::to_string(end) : "null") + "}";
+}
+
 bool Query::IsQuery() {
 	return true;
 }
@@ -1,10 +1,125 @@
 #pragma once
 
 class Query : public Operation {
+public:
+	//values bigger than this are left out of the rows of a chunked query
+	static constexpr size_t ChunkThreshold = 1 << 16;
+	//the most ReadChunk will hand back at once
+	static constexpr size_t ChunkLimit = 1 << 20;
+protected:
+	//Shared between the game thread and the worker, who may outlive the Query. Nothing here is locked: rows go through the queue and whoever wins the status exchange decides what happens to the worker's resources
+	struct ResultState {
+		enum Status {
+			Running,
+			Complete,
+			Abandoned
+		};
+
+		std::atomic_int status;
+		//an empty row marks the start of the next result set
+		RowQueue results;
+		//only valid to read after seeing Complete
+		std::string error;
+		int errnum;
+		//what the statements left behind, only valid to read after seeing Complete
+		unsigned long long affectedRows, insertId;
+		unsigned int warnings;
+		//when the worker was done, only valid to read after seeing Complete
+		std::chrono::steady_clock::time_point finishedAt;
+		//rows go here instead of the queue when set, the worker's alone once it starts
+		std::unique_ptr<ExportFile> exportFile;
+		//oversized values are kept here instead of in the row, set before the worker starts
+		bool chunked;
+		//the worker adds to it and the game thread reads from it at the same time
+		std::mutex blobLock;
+		std::vector<std::string> blobs;
+
+		ResultState();
+		virtual ~ResultState() = default;
+
+		//worker side, false if the Query was abandoned and the worker must clean up after itself
+		bool Finish();
+		bool IsAbandoned();
+		//game thread side, false if the worker already finished
+		bool Abandon();
+	};
+public:
+	//One worker's rows handed to every query reading the same thing, see Connection::Shared. The worker and whoever joins take turns under the lock so each queue still has one producer at a time
+	struct Flight {
+		std::mutex lock;
+		std::vector<std::shared_ptr<ResultState>> readers;
+		//everything pushed so far so a late reader can catch up
+		std::vector<std::string> history;
+		//the worker is done with it or nobody is listening, too late to join
+		bool landed;
+
+		Flight();
+
+		//game thread side, false if the reader needs a worker of its own
+		bool Join(const std::shared_ptr<ResultState>& reader);
+		bool Landed();
+		//worker side, false once every reader has been abandoned
+		bool Push(std::string&& row);
+		//hands the worker's error to everyone but the worker's own state, which is left for the caller to finish
+		void Land(const ResultState& result);
+	};
+private:
+	Connection& owner;
 protected:
+	const std::shared_ptr<ResultState> state;
 	std::string currentRow;
+	unsigned int resultSet;
+	//reached a marker, reads stay at the end of the set until NextResultSet
+	bool setEnded;
+	bool started, complete;
+	unsigned long long affectedRows, insertId;
+	unsigned int warnings;
+	//when the worker was started
+	std::chrono::steady_clock::time_point startedAt;
+private:
+	//a copy of the text for the library's digests, empty unless they're on
+	std::string digestText;
+	unsigned long long rowsRead;
+	//DM's to release, not something the library polls on its own
+	bool reclaimable;
+	//went to the connection's spool instead of the server
+	bool spooled;
+protected:
+	Query(Connection& owner, std::shared_ptr<ResultState>&& state);
+
+	//worker side, appends the json for one column value or a {"blob":N,"length":N} handle in its place
+	static void AppendValue(std::string& json, const char* const value, const size_t length, ResultState& localState);
+
+	bool ReadResults(bool noSkip);
+	//once the query is done for good, only for queries that ran on a worker of their own
+	void RecordDigest();
 public:
 	std::string CurrentRow() const;
+	unsigned int CurrentResultSet() const;
+	//only meaningful once CurrentRow() is empty, false if there are no more result sets
+	bool NextResultSet();
+	//{"affectedRows":N,"insertId":N,"warnings":N,"spooled":0|1}, empty until the worker is done
+	std::string Info() const;
+	//{"data":"...","next":N} with a null next at the end of the value, empty if there is no such blob
+	std::string ReadChunk(const size_t blob, const size_t offset, const size_t length) const;
+
+	//start the worker if the connection has the resources for it, true if the query no longer needs to wait
+	virtual bool TryStart() = 0;
+	//completes it with an error instead, only before it has been queued
+	void Reject(std::string&& message, const int code);
+	//completes it without error, the spool has the text now
+	void MarkSpooled();
+	//see QueryDigests
+	void TrackDigest(const std::string& queryText);
+	//see Connection::ReclaimIdle
+	void SetReclaimable();
+	//DM's and has nothing left running
+	bool Reclaimable() const;
+	//what it's holding on to for DM, only once Reclaimable
+	size_t BufferedBytes() const;
+	//the later of DM last asking about it and the worker finishing, only once Reclaimable
+	std::chrono::steady_clock::time_point IdleSince() const;
 
+	bool IsComplete(bool noSkip) override;
 	bool IsQuery() override;
-};
\ No newline at end of file
+};
@@ -0,0 +1,292 @@
+#include "BSQL.h"
+
+QueryDigests::Entry::Entry() :
+	calls(0),
+	errors(0),
+	rows(0),
+	totalTime(std::chrono::steady_clock::duration::zero()),
+	maxTime(std::chrono::steady_clock::duration::zero()),
+	planConnection(nullptr)
+{}
+
+QueryDigests::QueryDigests() :
+	enabled(false),
+	slowThreshold(std::chrono::steady_clock::duration::zero()),
+	untracked(0)
+{}
+
+std::string QueryDigests::Fingerprint(const std::string& queryText) {
+	const auto isWord([](const char c) {
+		return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$' || (c & 0x80) != 0;
+	});
+
+	std::string stripped;
+	stripped.reserve(queryText.length());
+	auto space(false);
+	for (size_t I(0); I < queryText.length();) {
+		const auto c(queryText[I]);
+		const auto next(I + 1 < queryText.length() ? queryText[I + 1] : '\0');
+		if (std::isspace(static_cast<unsigned char>(c))) {
+			space = true;
+			++I;
+			continue;
+		}
+		if (c == '#' || (c == '-' && next == '-' && (I + 2 >= queryText.length() || std::isspace(static_cast<unsigned char>(queryText[I + 2]))))) {
+			I = queryText.find('\n', I);
+			if (I == std::string::npos)
+				break;
+			space = true;
+			continue;
+		}
+		if (c == '/' && next == '*') {
+			I = queryText.find("*/", I + 2);
+			if (I == std::string::npos)
+				break;
+			I += 2;
+			space = true;
+			continue;
+		}
+
+		if (space && !stripped.empty() && stripped.back() != '(' && stripped.back() != ' ' && c != ')' && c != ',')
+			stripped.push_back(' ');
+		space = false;
+
+		if (c == '\'' || c == '"') {
+			//doubled quotes and backslashes both escape
+			for (++I; I < queryText.length(); ++I) {
+				if (queryText[I] == '\\')
+					++I;
+				else if (queryText[I] == c) {
+					if (I + 1 < queryText.length() && queryText[I + 1] == c)
+						++I;
+					else
+						break;
+				}
+			}
+			++I;
+			stripped.push_back('?');
+		}
+		else if (c == '`') {
+			//names are kept as they are
+			const auto start(I);
+			for (++I; I < queryText.length(); ++I)
+				if (queryText[I] == '`') {
+					if (I + 1 < queryText.length() && queryText[I + 1] == '`')
+						++I;
+					else
+						break;
+				}
+			I = std::min(I + 1, queryText.length());
+			stripped.append(queryText, start, I - start);
+		}
+		else if (std::isdigit(static_cast<unsigned char>(c)) && (stripped.empty() || !isWord(stripped.back()))) {
+			//covers 0x1F, 1.5 and 1e10 alike
+			while (I < queryText.length() && (isWord(queryText[I]) || queryText[I] == '.'))
+				++I;
+			stripped.push_back('?');
+		}
+		else if (c == ',') {
+			stripped.append(", ");
+			space = false;
+			++I;
+		}
+		else {
+			stripped.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+			++I;
+		}
+	}
+	while (!stripped.empty() && (stripped.back() == ' ' || stripped.back() == ';'))
+		stripped.pop_back();
+
+	//IN lists and VALUES rows of any length look the same
+	const auto listEnd([&stripped](const size_t position) {
+		if (position >= stripped.length() || stripped[position] != '(')
+			return std::string::npos;
+		const auto end(stripped.find(')', position));
+		if (end == std::string::npos || end == position + 1 || stripped.find_first_not_of("?, ", position + 1) < end)
+			return std::string::npos;
+		return end + 1;
+	});
+	std::string fingerprint;
+	fingerprint.reserve(stripped.length());
+	for (size_t I(0); I < stripped.length();) {
+		auto end(listEnd(I));
+		if (end == std::string::npos) {
+			fingerprint.push_back(stripped[I++]);
+			continue;
+		}
+		fingerprint.append("(?+)");
+		while (stripped.compare(end, 2, ", ") == 0) {
+			const auto nextEnd(listEnd(end + 2));
+			if (nextEnd == std::string::npos)
+				break;
+			end = nextEnd;
+		}
+		I = end;
+	}
+	return fingerprint;
+}
+
+bool QueryDigests::Explainable(const std::string& fingerprint) {
+	for (const auto I : { "select ", "insert ", "update ", "delete ", "replace ", "with " })
+		if (fingerprint.compare(0, std::strlen(I), I) == 0)
+			return true;
+	return false;
+}
+
+void QueryDigests::ReleasePlans() {
+	for (auto& I : explaining) {
+		auto& entry(I->second);
+		entry.planConnection->ReleaseOperation(entry.planOperation);
+		entry.planConnection = nullptr;
+		entry.planOperation.clear();
+		entry.planRows.clear();
+	}
+	explaining.clear();
+}
+
+void QueryDigests::Start(const std::chrono::steady_clock::duration newSlowThreshold) {
+	ReleasePlans();
+	entries.clear();
+	untracked = 0;
+	slowThreshold = newSlowThreshold;
+	enabled = true;
+}
+
+void QueryDigests::Stop() {
+	enabled = false;
+}
+
+bool QueryDigests::Enabled() const {
+	return enabled;
+}
+
+void QueryDigests::Record(Connection& connection, std::string&& queryText, const std::chrono::steady_clock::duration elapsed, const unsigned long long rows, const bool failed) {
+	if (!enabled)
+		return;
+	auto fingerprint(Fingerprint(queryText));
+	auto iter(entries.find(fingerprint));
+	if (iter == entries.end()) {
+		if (entries.size() >= MaxEntries) {
+			++untracked;
+			return;
+		}
+		iter = entries.emplace(std::move(fingerprint), Entry()).first;
+	}
+
+	auto& entry(iter->second);
+	++entry.calls;
+	if (failed)
+		++entry.errors;
+	entry.rows += rows;
+	entry.totalTime += elapsed;
+	if (entry.calls == 1 || elapsed > entry.maxTime) {
+		entry.maxTime = elapsed;
+		//cut on a UTF-8 character boundary
+		auto length(std::min(queryText.length(), static_cast<size_t>(SampleLength)));
+		while (length < queryText.length() && length > 0 && (queryText[length] & 0xC0) == 0x80)
+			--length;
+		entry.sample = queryText.substr(0, length);
+	}
+
+	//once per shape, the first run that's slow enough is the one explained
+	if (failed || slowThreshold == std::chrono::steady_clock::duration::zero() || elapsed < slowThreshold || !entry.plan.empty() || !entry.planOperation.empty() || !Explainable(iter->first))
+		return;
+	explaining.reserve(explaining.size() + 1);
+	auto operation(connection.Explain(queryText));
+	if (operation.empty())
+		return;
+	entry.planConnection = &connection;
+	entry.planOperation = std::move(operation);
+	explaining.emplace_back(iter);
+}
+
+void QueryDigests::CollectPlans() {
+	for (auto I(explaining.begin()); I != explaining.end();) {
+		auto& entry((*I)->second);
+		const auto operation(entry.planConnection->GetOperation(entry.planOperation));
+		auto done(!operation);
+		if (operation) {
+			auto& query(*static_cast<Query*>(operation));
+			for (;;) {
+				if (!query.IsComplete(false))
+					break;
+				auto row(query.CurrentRow());
+				if (!row.empty()) {
+					if (!entry.planRows.empty())
+						entry.planRows.append(",");
+					entry.planRows.append(row);
+				}
+				else if (!query.NextResultSet()) {
+					done = true;
+					//a failed EXPLAIN is left unexplained, a later slow run gets to try again
+					if (query.GetError().empty())
+						entry.plan = "[" + entry.planRows + "]";
+					entry.planConnection->ReleaseOperation(entry.planOperation);
+					break;
+				}
+			}
+		}
+		if (!done) {
+			++I;
+			continue;
+		}
+		entry.planConnection = nullptr;
+		entry.planOperation.clear();
+		entry.planRows.clear();
+		I = explaining.erase(I);
+	}
+}
+
+void QueryDigests::Forget(Connection& connection) {
+	for (auto I(explaining.begin()); I != explaining.end();) {
+		auto& entry((*I)->second);
+		if (entry.planConnection != &connection) {
+			++I;
+			continue;
+		}
+		entry.planConnection = nullptr;
+		entry.planOperation.clear();
+		entry.planRows.clear();
+		I = explaining.erase(I);
+	}
+}
+
+std::string QueryDigests::GetStats(const size_t count) const {
+	std::vector<std::map<std::string, Entry>::const_iterator> sorted;
+	sorted.reserve(entries.size());
+	for (auto I(entries.begin()); I != entries.end(); ++I)
+		sorted.emplace_back(I);
+	const auto shown(count == 0 ? sorted.size() : std::min(count, sorted.size()));
+	std::partial_sort(sorted.begin(), sorted.begin() + shown, sorted.end(), [](const std::map<std::string, Entry>::const_iterator& a, const std::map<std::string, Entry>::const_iterator& b) {
+		return a->second.totalTime > b->second.totalTime;
+	});
+
+	std::string json("{\"untracked\":");
+	json.append(std::to_string(untracked));
+	json.append(",\"digests\":[");
+	for (auto I(sorted.begin()); I != sorted.begin() + shown; ++I) {
+		const auto& entry((*I)->second);
+		if (I != sorted.begin())
+			json.append(",");
+		json.append("{\"fingerprint\":\"");
+		json.append(Library::EscapeJsonString((*I)->first));
+		json.append("\",\"calls\":");
+		json.append(std::to_string(entry.calls));
+		json.append(",\"errors\":");
+		json.append(std::to_string(entry.errors));
+		json.append(",\"rows\":");
+		json.append(std::to_string(entry.rows));
+		json.append(",\"totalUs\":");
+		json.append(std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(entry.totalTime).count()));
+		json.append(",\"maxUs\":");
+		json.append(std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(entry.maxTime).count()));
+		json.append(",\"sample\":\"");
+		json.append(Library::EscapeJsonString(entry.sample));
+		json.append("\",\"plan\":");
+		json.append(entry.plan.empty() ? "null" : entry.plan);
+		json.append("}");
+	}
+	json.append("]}");
+	return json;
+}
\ No newline at end of file
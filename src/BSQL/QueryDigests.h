@@ -0,0 +1,55 @@
+#pragma once
+
+//Finished queries from DM grouped by their text with the values taken out, so the shapes that cost the most stand out. Only what ran on a worker is counted, timed from the worker starting to it finishing
+class QueryDigests {
+public:
+	//distinct shapes kept, anything new past this is only counted
+	static constexpr size_t MaxEntries = 1000;
+	//how much of the slowest run's text is kept
+	static constexpr size_t SampleLength = 1024;
+private:
+	struct Entry {
+		unsigned long long calls, errors, rows;
+		std::chrono::steady_clock::duration totalTime, maxTime;
+		std::string sample;
+		//rows of the EXPLAIN as a json array, empty until one finished
+		std::string plan;
+		//the EXPLAIN in progress, empty when there isn't one
+		Connection* planConnection;
+		std::string planOperation, planRows;
+
+		Entry();
+	};
+private:
+	bool enabled;
+	//0 explains nothing
+	std::chrono::steady_clock::duration slowThreshold;
+	std::map<std::string, Entry> entries;
+	unsigned long long untracked;
+	//entries with an EXPLAIN in progress
+	std::vector<std::map<std::string, Entry>::iterator> explaining;
+private:
+	//only statements EXPLAIN understands
+	static bool Explainable(const std::string& fingerprint);
+
+	void ReleasePlans();
+public:
+	QueryDigests();
+
+	//literals become ?, lists of them (?+), comments and extra whitespace go away and the rest is lowercased
+	static std::string Fingerprint(const std::string& queryText);
+
+	//clears what was recorded so far
+	void Start(const std::chrono::steady_clock::duration slowThreshold);
+	void Stop();
+	bool Enabled() const;
+
+	void Record(Connection& connection, std::string&& queryText, const std::chrono::steady_clock::duration elapsed, const unsigned long long rows, const bool failed);
+	//takes the rows of finished EXPLAINs and hands their operations back
+	void CollectPlans();
+	//the connection is going away along with its EXPLAINs
+	void Forget(Connection& connection);
+
+	//{"untracked":N,"digests":[{"fingerprint":"...","calls":N,"errors":N,"rows":N,"totalUs":N,"maxUs":N,"sample":"...","plan":[{...},...]|null},...]} with the count that took the longest in total, 0 for all of them
+	std::string GetStats(const size_t count) const;
+};
\ No newline at end of file
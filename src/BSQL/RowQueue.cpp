@@ -0,0 +1,73 @@
+#include "BSQL.h"
+
+RowQueue::Segment::Segment() :
+	written(0),
+	next(nullptr)
+{}
+
+RowQueue::RowQueue() :
+	head(new Segment()),
+	readIndex(0),
+	tail(head)
+{}
+
+RowQueue::~RowQueue() {
+	while (head) {
+		auto next(head->next.load(std::memory_order_relaxed));
+		delete head;
+		head = next;
+	}
+}
+
+void RowQueue::Push(std::string&& row) {
+	auto written(tail->written.load(std::memory_order_relaxed));
+	if (written == SegmentSize) {
+		//allocate before publishing anything so a bad_alloc leaves us untouched
+		auto next(new Segment());
+		tail->next.store(next, std::memory_order_release);
+		tail = next;
+		written = 0;
+	}
+	tail->rows[written] = std::move(row);
+	tail->written.store(written + 1, std::memory_order_release);
+}
+
+bool RowQueue::Advance() {
+	//true if there's a row at readIndex
+	for (;;) {
+		if (readIndex < head->written.load(std::memory_order_acquire))
+			return true;
+		if (readIndex < SegmentSize)
+			return false;
+		auto next(head->next.load(std::memory_order_acquire));
+		if (!next)
+			return false;
+		delete head;
+		head = next;
+		readIndex = 0;
+	}
+}
+
+bool RowQueue::Pop(std::string& row) {
+	if (!Advance())
+		return false;
+	row = std::move(head->rows[readIndex++]);
+	return true;
+}
+
+bool RowQueue::Empty() {
+	return !Advance();
+}
+
+
+size_t RowQueue::Bytes() const {
+	size_t bytes(0);
+	auto index(readIndex);
+	for (auto segment(head); segment; segment = segment->next.load(std::memory_order_acquire)) {
+		const auto written(segment->written.load(std::memory_order_acquire));
+		for (; index < written; ++index)
+			bytes += segment->rows[index].length();
+		index = 0;
+	}
+	return bytes;
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+//Unbounded single producer/single consumer queue of rows. Rows live in fixed size ring segments that are chained together when the producer gets ahead and freed by the consumer once drained. Neither side ever locks
+class RowQueue {
+private:
+	static constexpr size_t SegmentSize = 64;
+
+	struct Segment {
+		std::string rows[SegmentSize];
+		//only written by the producer, published with release so the consumer sees the row contents
+		std::atomic_size_t written;
+		std::atomic<Segment*> next;
+
+		Segment();
+	};
+private:
+	//consumer side
+	Segment* head;
+	size_t readIndex;
+	//producer side
+	Segment* tail;
+private:
+	bool Advance();
+public:
+	RowQueue();
+	RowQueue(const RowQueue&) = delete;
+	RowQueue(RowQueue&&) = delete;
+	~RowQueue();
+
+	//producer only
+	void Push(std::string&& row);
+
+	//consumer only
+	bool Pop(std::string& row);
+	bool Empty();
+	//consumer only, once the producer is done with it
+	size_t Bytes() const;
+};
@@ -0,0 +1,128 @@
+#include "BSQL.h"
+
+Schedule::Schedule(const std::string& connectionIdentifier, std::string&& queryText, const std::chrono::steady_clock::duration interval, const Connection::Priority priority, const unsigned int flags) :
+	queryText(std::move(queryText)),
+	interval(interval),
+	priority(priority),
+	flags(flags),
+	nextRun(std::chrono::steady_clock::now()),
+	runs(0),
+	failures(0),
+	skipped(0),
+	lastErrno(0),
+	connectionIdentifier(connectionIdentifier)
+{}
+
+void Schedule::Collect(Connection& connection) {
+	const auto operation(connection.GetOperation(operationIdentifier));
+	if (!operation) {
+		operationIdentifier.clear();
+		return;
+	}
+
+	auto& query(*static_cast<Query*>(operation));
+	for (;;) {
+		if (!query.IsComplete(false))
+			return;
+		auto row(query.CurrentRow());
+		if (!row.empty())
+			TakeRow(std::move(row));
+		else if (!query.NextResultSet())
+			break;
+	}
+
+	auto error(query.GetError());
+	const auto failed(!error.empty());
+	if (!failed)
+		lastRow = std::move(runRow);
+	else {
+		++failures;
+		lastError = std::move(error);
+		lastErrno = query.GetErrno();
+	}
+	runRow.clear();
+	connection.ReleaseOperation(operationIdentifier);
+	operationIdentifier.clear();
+	Finished(failed);
+}
+
+std::string Schedule::NextQuery() const {
+	return queryText;
+}
+
+bool Schedule::Ready() const {
+	return true;
+}
+
+void Schedule::TakeRow(std::string&& row) {
+	//nobody else will read the rows, they're thrown away as they come in
+	if (runRow.empty())
+		runRow = std::move(row);
+}
+
+void Schedule::Finished(const bool failed) {}
+
+std::chrono::steady_clock::time_point Schedule::Run(Connection& connection, const std::chrono::steady_clock::time_point now) {
+	//a run that's going gets looked in on so its rows don't wait for the next one
+	const auto collectInterval(std::chrono::milliseconds(100));
+	if (!operationIdentifier.empty())
+		Collect(connection);
+	if (now < nextRun)
+		return operationIdentifier.empty() ? nextRun : std::min(nextRun, now + collectInterval);
+
+	//a late run doesn't get made up for
+	nextRun += interval;
+	if (nextRun <= now)
+		nextRun = now + interval;
+
+	if (!operationIdentifier.empty() || !Ready()) {
+		++skipped;
+		return nextRun;
+	}
+
+	++runs;
+	operationIdentifier = connection.CreateQuery(NextQuery(), priority, flags, nullptr, false);
+	if (operationIdentifier.empty()) {
+		++failures;
+		lastError = "Error creating query! Is the connection complete?";
+		lastErrno = -1;
+	}
+	else
+		//a query that was shed or finished right away is done with already
+		Collect(connection);
+	return operationIdentifier.empty() ? nextRun : std::min(nextRun, now + collectInterval);
+}
+
+void Schedule::Stop(Connection& connection) {
+	if (operationIdentifier.empty())
+		return;
+	connection.ReleaseOperation(operationIdentifier);
+	operationIdentifier.clear();
+}
+
+std::string Schedule::GetStats() const {
+	std::string json("{\"runs\":");
+	json.append(std::to_string(runs));
+	json.append(",\"failures\":");
+	json.append(std::to_string(failures));
+	json.append(",\"skipped\":");
+	json.append(std::to_string(skipped));
+	json.append(",\"running\":");
+	json.append(operationIdentifier.empty() ? "0" : "1");
+	json.append(",\"lastRow\":");
+	json.append(lastRow.empty() ? "null" : lastRow);
+	if (lastError.empty())
+		json.append(",\"lastError\":null,\"lastErrorCode\":null}");
+	else {
+		json.append(",\"lastError\":\"");
+		json.append(Library::EscapeJsonString(lastError));
+		json.append("\",\"lastErrorCode\":");
+		json.append(std::to_string(lastErrno));
+		json.append("}");
+	}
+	return json;
+}
+
+bool Schedule::IsFeed() const {
+	return false;
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+//A query the dispatcher runs over and over on its own, DM only hears about it when it asks. A run that's still going when the next is due makes that one get skipped
+class Schedule {
+private:
+	const std::string queryText;
+	const std::chrono::steady_clock::duration interval;
+	const Connection::Priority priority;
+	const unsigned int flags;
+protected:
+	std::chrono::steady_clock::time_point nextRun;
+private:
+	//the run in progress, empty between runs
+	std::string operationIdentifier;
+	//first row of the run in progress
+	std::string runRow;
+	unsigned long long runs, failures, skipped;
+	std::string lastRow, lastError;
+	int lastErrno;
+private:
+	//releases the run in progress once it's done with it
+	void Collect(Connection& connection);
+protected:
+	//what the next run sends
+	virtual std::string NextQuery() const;
+	//false to sit this one out
+	virtual bool Ready() const;
+	//every row of a run as it's read off
+	virtual void TakeRow(std::string&& row);
+	//the run is over and everything it returned has been taken
+	virtual void Finished(const bool failed);
+public:
+	const std::string connectionIdentifier;
+public:
+	//the first run is due right away
+	Schedule(const std::string& connectionIdentifier, std::string&& queryText, const std::chrono::steady_clock::duration interval, const Connection::Priority priority, const unsigned int flags);
+	Schedule(const Schedule&) = delete;
+	Schedule(Schedule&&) = delete;
+	virtual ~Schedule() = default;
+
+	//collects the last run and starts the next if it's due, returns when it wants to be looked at again
+	std::chrono::steady_clock::time_point Run(Connection& connection, const std::chrono::steady_clock::time_point now);
+	//releases the run in progress, if any
+	void Stop(Connection& connection);
+
+	//{"runs":N,"failures":N,"skipped":N,"running":0|1,"lastRow":{...}|null,"lastError":"..."|null,"lastErrorCode":N|null}
+	virtual std::string GetStats() const;
+	virtual bool IsFeed() const;
+};
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "BSQL.h"
+
+Spool::Spool(const std::string& path, const unsigned long long maxBytes) :
+	path(path),
+	offsetPath(path + ".offset"),
+	maxBytes(maxBytes),
+	size(0),
+	offset(0),
+	frontEnd(0),
+	pending(0),
+	spooled(0),
+	replayed(0),
+	rejected(0),
+	dropped(0),
+	unsavedPops(0)
+{}
+
+Spool::~Spool() {
+	if (unsavedPops > 0)
+		SaveOffset();
+}
+
+bool Spool::ReadEntry(const unsigned long long at, std::string& text, unsigned long long& end) {
+	file.clear();
+	file.seekg(static_cast<std::streamoff>(at));
+	unsigned long long length;
+	if (!(file >> length) || file.get() != '\n' || length > maxBytes)
+		return false;
+	text.resize(static_cast<size_t>(length));
+	if (length > 0 && !file.read(&text[0], static_cast<std::streamsize>(length)))
+		return false;
+	if (file.get() != '\n')
+		return false;
+	end = static_cast<unsigned long long>(file.tellg());
+	return true;
+}
+
+bool Spool::Reset() {
+	file.close();
+	file.clear();
+	file.open(path, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+	std::remove(offsetPath.c_str());
+	size = 0;
+	offset = 0;
+	front.clear();
+	frontEnd = 0;
+	pending = 0;
+	unsavedPops = 0;
+	return file.is_open();
+}
+
+void Spool::SaveOffset() {
+	std::ofstream offsetFile(offsetPath, std::ios::out | std::ios::trunc);
+	offsetFile << offset;
+	unsavedPops = 0;
+}
+
+void Spool::Compact() {
+	const auto unsent(size - offset);
+	//the entries being moved have to stay where path.offset says until it says 0, so a crash partway leaves either layout whole
+	if (unsent >= offset)
+		return;
+	SaveOffset();
+	std::vector<char> buffer(64 * 1024);
+	for (auto I(0ULL); I < unsent;) {
+		const auto chunk(static_cast<std::streamsize>(std::min<unsigned long long>(buffer.size(), unsent - I)));
+		file.clear();
+		file.seekg(static_cast<std::streamoff>(offset + I));
+		if (!file.read(buffer.data(), chunk))
+			return;
+		file.seekp(static_cast<std::streamoff>(I));
+		if (!file.write(buffer.data(), chunk))
+			return;
+		I += static_cast<unsigned long long>(chunk);
+	}
+	//the old entries are still past the end, don't let them be read back as new ones
+	file.seekp(static_cast<std::streamoff>(unsent));
+	file.put('x');
+	file.flush();
+	if (!file.good()) {
+		file.clear();
+		return;
+	}
+	if (frontEnd != 0)
+		frontEnd -= offset;
+	size = unsent;
+	offset = 0;
+	SaveOffset();
+}
+
+bool Spool::Open() {
+	std::ifstream offsetFile(offsetPath);
+	if (!(offsetFile >> offset))
+		offset = 0;
+	offsetFile.close();
+
+	file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+	if (!file.is_open())
+		return Reset();
+
+	//an entry cut short by a crash ends it, the next one is written over it
+	size = offset;
+	std::string text;
+	unsigned long long end;
+	while (ReadEntry(size, text, end)) {
+		size = end;
+		++pending;
+	}
+	file.clear();
+	if (pending == 0)
+		return Reset();
+	return true;
+}
+
+bool Spool::Append(const std::string& queryText) {
+	auto entry(std::to_string(queryText.length()));
+	entry.append("\n");
+	entry.append(queryText);
+	entry.append("\n");
+	if (!file.is_open() || size - offset + entry.length() > maxBytes)
+		return false;
+	if (offset > maxBytes / 2)
+		Compact();
+
+	//ends the file for Open, the next entry goes over it
+	entry.push_back('x');
+	file.clear();
+	file.seekp(static_cast<std::streamoff>(size));
+	file.write(entry.c_str(), static_cast<std::streamsize>(entry.length()));
+	file.flush();
+	if (!file.good()) {
+		//size didn't move so whatever made it out is written over
+		file.clear();
+		return false;
+	}
+	size += entry.length() - 1;
+	++pending;
+	++spooled;
+	return true;
+}
+
+void Spool::Drop() {
+	++dropped;
+}
+
+bool Spool::Empty() const {
+	return pending == 0;
+}
+
+bool Spool::Front(std::string& queryText) {
+	if (pending == 0)
+		return false;
+	if (frontEnd == 0 && !ReadEntry(offset, front, frontEnd)) {
+		dropped += pending;
+		Reset();
+		return false;
+	}
+	queryText = front;
+	return true;
+}
+
+void Spool::Pop(const bool sent) {
+	if (frontEnd == 0)
+		return;
+	if (sent)
+		++replayed;
+	else
+		++rejected;
+	offset = frontEnd;
+	front.clear();
+	frontEnd = 0;
+	if (--pending == 0) {
+		Reset();
+		return;
+	}
+	//a crash before this is written sends the entries since the last time again next round
+	const auto popsPerSave(100U);
+	if (++unsavedPops >= popsPerSave)
+		SaveOffset();
+}
+
+std::string Spool::GetStats() const {
+	std::string json("{\"pending\":");
+	json.append(std::to_string(pending));
+	json.append(",\"bytes\":");
+	json.append(std::to_string(size - offset));
+	json.append(",\"spooled\":");
+	json.append(std::to_string(spooled));
+	json.append(",\"replayed\":");
+	json.append(std::to_string(replayed));
+	json.append(",\"rejected\":");
+	json.append(std::to_string(rejected));
+	json.append(",\"dropped\":");
+	json.append(std::to_string(dropped));
+	json.append("}");
+	return json;
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+//Writes that couldn't reach the server, kept on disk in the order they came in until they can be sent. Each entry is its length, a newline, the text and another newline, the last one is followed by an x. How far replay got is kept beside it in path.offset, both are cleared once everything has been sent and the unsent entries are moved to the front once enough has been sent before them
+class Spool {
+private:
+	const std::string path, offsetPath;
+	const unsigned long long maxBytes;
+	std::fstream file;
+	//where the next entry goes and where the oldest one not yet sent starts
+	unsigned long long size, offset;
+	//the oldest entry once it's been read, and where the one after it starts, 0 if it hasn't been
+	std::string front;
+	unsigned long long frontEnd;
+	unsigned long long pending, spooled, replayed, rejected, dropped;
+	//entries sent since path.offset was last written
+	unsigned int unsavedPops;
+private:
+	bool ReadEntry(const unsigned long long at, std::string& text, unsigned long long& end);
+	//truncates the file and forgets the offset
+	bool Reset();
+	void SaveOffset();
+	//moves the unsent entries over the sent ones, leaves things as they were if that can't be done safely
+	void Compact();
+public:
+	Spool(const std::string& path, const unsigned long long maxBytes);
+	Spool(const Spool&) = delete;
+	Spool(Spool&&) = delete;
+	~Spool();
+
+	//picks up whatever a previous round left unsent, false if the file can't be opened
+	bool Open();
+	//false if it would take what's unsent over maxBytes or couldn't be written
+	bool Append(const std::string& queryText);
+	//counts a statement that should have gone in but was lost instead
+	void Drop();
+	bool Empty() const;
+	//the oldest entry not yet sent, false if there is none. An entry that can't be read makes the rest of the file count as dropped
+	bool Front(std::string& queryText);
+	//done with Front(), sent says if the server took it or turned it down
+	void Pop(const bool sent);
+
+	//{"pending":N,"bytes":N,"spooled":N,"replayed":N,"rejected":N,"dropped":N}
+	std::string GetStats() const;
+};
\ No newline at end of file
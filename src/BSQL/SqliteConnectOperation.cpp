@@ -0,0 +1,98 @@
+#include "BSQL.h"
+
+SqliteConnectOperation::SqliteConnectOperation(SqliteConnection& connPool, const std::string& path, const unsigned int timeout, const std::shared_ptr<std::atomic_uint_fast32_t>& threadCounter, ConcurrencyLimit& threadLimit) :
+	connPool(connPool),
+	handle(nullptr),
+	wal(false),
+	path(path),
+	complete(false),
+	started(false),
+	state(std::make_shared<ClassState>()),
+	threadCounter(threadCounter),
+	threadLimit(threadLimit),
+	timeout(timeout)
+{
+	TryStartConnecting();
+}
+
+void SqliteConnectOperation::TryStartConnecting() {
+	if (threadCounter->fetch_add(1) > threadLimit.Current()) {
+		--*threadCounter;
+		return;
+	}
+	started = true;
+	connectThread = std::thread(&SqliteConnectOperation::DoConnect, this, path, timeout, threadCounter, state, NewWorkerFlag());
+}
+
+void SqliteConnectOperation::DoConnect(const std::string localPath, const unsigned int localTimeout, std::shared_ptr<std::atomic_uint_fast32_t> localThreadCounter, std::shared_ptr<ClassState> localState, std::shared_ptr<std::atomic_bool> localExited) {
+	const ExitGuard exitGuard(localExited);
+	sqlite3* localHandle(nullptr);
+	auto result(SqliteConnection::OpenHandle(localPath, false, localTimeout, localHandle));
+
+	//WAL lets the readers run alongside the writer, NORMAL sync is still crash safe with it
+	bool localWal(false);
+	if (result == SQLITE_OK)
+		result = sqlite3_exec(localHandle, "PRAGMA journal_mode=WAL", [](void* walPtr, int columns, char** values, char**) {
+			*static_cast<bool*>(walPtr) = columns > 0 && values[0] && sqlite3_stricmp(values[0], "wal") == 0;
+			return 0;
+		}, &localWal, nullptr);
+	if (result == SQLITE_OK && localWal)
+		result = sqlite3_exec(localHandle, "PRAGMA synchronous=NORMAL", nullptr, nullptr, nullptr);
+
+	localState->lock.lock();
+	if (localState->alive) {
+		if (result != SQLITE_OK) {
+			error = localHandle ? sqlite3_errmsg(localHandle) : "Out of memory!";
+			errnum = localHandle ? sqlite3_extended_errcode(localHandle) : SQLITE_NOMEM;
+		}
+		else {
+			errnum = 0;
+			handle = localHandle;
+			wal = localWal;
+		}
+		complete = true;
+	}
+	if (result != SQLITE_OK || !localState->alive)
+		sqlite3_close_v2(localHandle);
+	localState->lock.unlock();
+	--*localThreadCounter;
+}
+
+bool SqliteConnectOperation::IsQuery() {
+	return false;
+}
+
+bool SqliteConnectOperation::IsComplete(bool noSkip) {
+	if (!started) {
+		TryStartConnecting();
+		return false;
+	}
+
+	if (!complete)
+		return false;
+
+	if (handle) {
+		connPool.SetWriter(handle, wal);
+		handle = nullptr;
+	}
+
+	return true;
+}
+
+std::thread* SqliteConnectOperation::GetActiveThread() {
+	if (!started)
+		return nullptr;
+
+	state->lock.lock();
+
+	if (IsComplete(false)) {
+		state->lock.unlock();
+		connectThread.join();
+		return nullptr;
+	}
+
+	state->alive = false;
+	state->lock.unlock();
+
+	return &connectThread;
+}
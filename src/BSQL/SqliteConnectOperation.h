@@ -0,0 +1,31 @@
+#pragma once
+
+class SqliteConnectOperation : public Operation {
+private:
+	SqliteConnection& connPool;
+	sqlite3* handle;
+	bool wal;
+
+	const std::string path;
+
+	std::atomic_bool complete;
+	bool started;
+	std::shared_ptr<ClassState> state;
+	std::thread connectThread;
+	//shared so abandoned threads can still give their slot back after everything is gone
+	const std::shared_ptr<std::atomic_uint_fast32_t> threadCounter;
+	ConcurrencyLimit& threadLimit;
+	const unsigned int timeout;
+private:
+	void TryStartConnecting();
+	void DoConnect(const std::string localPath, const unsigned int localTimeout, std::shared_ptr<std::atomic_uint_fast32_t> localThreadCounter, std::shared_ptr<ClassState> localState, std::shared_ptr<std::atomic_bool> localExited);
+public:
+	SqliteConnectOperation(SqliteConnection& connPool, const std::string& path, const unsigned int timeout, const std::shared_ptr<std::atomic_uint_fast32_t>& threadCounter, ConcurrencyLimit& threadLimit);
+	SqliteConnectOperation(const SqliteConnectOperation&) = delete;
+	SqliteConnectOperation(SqliteConnectOperation&&) = delete;
+	~SqliteConnectOperation() override = default;
+
+	bool IsComplete(bool noSkip) override;
+	bool IsQuery() override;
+	std::thread* GetActiveThread() override;
+};
@@ -0,0 +1,87 @@
+#include "BSQL.h"
+
+SqliteConnection::Writer::Writer(sqlite3* handle, const bool wal) :
+	handle(handle),
+	wal(wal)
+{}
+
+SqliteConnection::Writer::~Writer() {
+	sqlite3_close_v2(handle);
+}
+
+SqliteConnection::SqliteConnection(Library& library, const unsigned int asyncTimeout, const unsigned int blockingTimeout, const unsigned int threadLimit) :
+	Connection(Type::Sqlite, library, blockingTimeout, threadLimit),
+	threadCounter(std::make_shared<std::atomic_uint_fast32_t>(0)),
+	asyncTimeout(asyncTimeout)
+{}
+
+SqliteConnection::~SqliteConnection() {
+	ClearPending();
+	//return all reserved readers first
+	for (auto& I : operations) {
+		auto thread(I.second->GetActiveThread());
+		if (thread)
+			library.RegisterZombieThread(std::move(*thread), I.second->WorkerExited());
+	}
+	operations.clear();
+	while (!availableReaders.empty()) {
+		sqlite3_close_v2(availableReaders.top());
+		availableReaders.pop();
+	}
+}
+
+std::string SqliteConnection::Connect(const std::string& address, const unsigned short port, const std::string& username, const std::string& password, const std::string& database) {
+	//can't connect twice, the address is the path to the database file and everything else is meaningless
+	if (!operations.empty() || writer)
+		return std::string();
+
+	path = address;
+	return AddOp(std::make_unique<SqliteConnectOperation>(*this, path, asyncTimeout, threadCounter, threadLimit));
+}
+
+std::string SqliteConnection::CreateQuery(const std::string& queryText, const Priority priority, const unsigned int flags, std::unique_ptr<ExportFile>&& exportFile, const bool reclaimable) {
+	if (!writer)
+		return std::string();
+	return AdmitQuery(std::make_unique<SqliteQueryOperation>(*this, std::string(queryText), std::move(exportFile), (flags & Chunked) != 0, path, writer, asyncTimeout, threadCounter, threadLimit, library.GetDispatcher()), queryText, priority, reclaimable);
+}
+
+std::string SqliteConnection::Explain(const std::string& queryText) {
+	if (!writer)
+		return std::string();
+	return AddQuery(std::make_unique<SqliteQueryOperation>(*this, "EXPLAIN QUERY PLAN " + queryText, nullptr, false, path, writer, asyncTimeout, threadCounter, threadLimit, library.GetDispatcher()), Bulk);
+}
+
+int SqliteConnection::OpenHandle(const std::string& path, const bool readOnly, const unsigned int timeout, sqlite3*& handle) {
+	//handles are only ever used by one thread at a time, the writer's lock covers the rest
+	const auto result(sqlite3_open_v2(path.c_str(), &handle, (readOnly ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE) | SQLITE_OPEN_NOMUTEX, nullptr));
+	if (result == SQLITE_OK)
+		sqlite3_busy_timeout(handle, timeout == 0 || timeout > std::numeric_limits<int>::max() / 1000 ? std::numeric_limits<int>::max() : static_cast<int>(timeout * 1000));
+	return result;
+}
+
+void SqliteConnection::SetWriter(sqlite3* handle, const bool wal) {
+	writer = std::make_shared<Writer>(handle, wal);
+}
+
+sqlite3* SqliteConnection::RequestReader() {
+	//empty pool is fine, the query will open its own and give it to us later
+	if (availableReaders.empty())
+		return nullptr;
+	auto front(availableReaders.top());
+	availableReaders.pop();
+	return front;
+}
+
+void SqliteConnection::ReleaseReader(sqlite3* reader) {
+	availableReaders.emplace(reader);
+	StartPending();
+}
+
+std::string SqliteConnection::Quote(const std::string& str) {
+	const auto quoted(sqlite3_mprintf("%q", str.c_str()));
+	if (!quoted)
+		throw std::bad_alloc();
+	std::string result(quoted);
+	sqlite3_free(quoted);
+	return result;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+class SqliteConnection : public Connection {
+public:
+	//the single handle allowed to write to the database, shared with running queries so it outlives abandoned threads
+	struct Writer {
+		std::mutex lock;
+		sqlite3* const handle;
+		//without WAL (i.e. in memory databases) readers can't see the writer's data so it does everything
+		const bool wal;
+
+		Writer(sqlite3* handle, const bool wal);
+		Writer(const Writer&) = delete;
+		Writer(Writer&&) = delete;
+		~Writer();
+	};
+private:
+	std::string path;
+
+	std::shared_ptr<Writer> writer;
+	std::stack<sqlite3*> availableReaders;
+
+	const std::shared_ptr<std::atomic_uint_fast32_t> threadCounter;
+
+	const unsigned int asyncTimeout;
+public:
+	SqliteConnection(Library& library, const unsigned int asyncTimeout, const unsigned int blockingTimeout, const unsigned int threadLimit);
+	~SqliteConnection() override;
+
+	std::string Connect(const std::string& address, const unsigned short port, const std::string& username, const std::string& password, const std::string& database) override;
+	std::string CreateQuery(const std::string& queryText, const Priority priority, const unsigned int flags, std::unique_ptr<ExportFile>&& exportFile, const bool reclaimable) override;
+	std::string Quote(const std::string& str) override;
+	std::string Explain(const std::string& queryText) override;
+
+	static int OpenHandle(const std::string& path, const bool readOnly, const unsigned int timeout, sqlite3*& handle);
+
+	void SetWriter(sqlite3* handle, const bool wal);
+	sqlite3* RequestReader();
+	void ReleaseReader(sqlite3* reader);
+};
@@ -0,0 +1,239 @@
+#include "BSQL.h"
+
+SqliteQueryOperation::SqliteQueryOperation(SqliteConnection& connPool, std::string&& queryText, std::unique_ptr<ExportFile>&& exportFile, const bool chunked, const std::string& path, const std::shared_ptr<SqliteConnection::Writer>& writer, const unsigned int timeout, const std::shared_ptr<std::atomic_uint_fast32_t>& threadCounter, ConcurrencyLimit& threadLimit, Dispatcher& dispatcher) :
+	Query(connPool, std::make_shared<SqliteResultState>()),
+	queryText(std::move(queryText)),
+	path(path),
+	connPool(connPool),
+	writer(writer),
+	reader(nullptr),
+	threadCounter(threadCounter),
+	threadLimit(threadLimit),
+	timeout(timeout),
+	dispatcher(dispatcher)
+{
+	state->exportFile = std::move(exportFile);
+	state->chunked = chunked;
+}
+
+SqliteQueryOperation::~SqliteQueryOperation() {
+	if (!reader)
+		return;
+	connPool.ReleaseReader(reader);
+}
+
+bool SqliteQueryOperation::TryStart() {
+	if (*threadCounter > threadLimit.Current())
+		return false;
+	++*threadCounter;
+	started = true;
+	startedAt = std::chrono::steady_clock::now();
+	//don't bother holding a reader if it can't be used
+	if (writer->wal)
+		reader = connPool.RequestReader();
+	operationThread = std::thread(&SqliteQueryOperation::StartQuery, reader, std::move(queryText), path, timeout, writer, threadCounter, std::ref(dispatcher), std::static_pointer_cast<SqliteResultState>(state), NewWorkerFlag());
+	return true;
+}
+
+void SqliteQueryOperation::Finish(sqlite3* db, const int result, sqlite3* localReader, std::atomic_uint_fast32_t& localThreadCounter, Dispatcher& localDispatcher, SqliteResultState& localState) {
+	if (result != SQLITE_OK && result != SQLITE_DONE) {
+		localState.error = db ? sqlite3_errmsg(db) : "Out of memory!";
+		localState.errnum = db ? sqlite3_extended_errcode(db) : SQLITE_NOMEM;
+	}
+	localState.openedReader = localReader;
+	localState.finishedAt = std::chrono::steady_clock::now();
+	if (!localState.Finish())
+		sqlite3_close_v2(localReader);
+	--localThreadCounter;
+	localDispatcher.Wake();
+}
+
+int SqliteQueryOperation::ExportRows(sqlite3_stmt* statement, ExportFile& exportFile, ResultState& localState) {
+	const auto numColumns(sqlite3_column_count(statement));
+	std::vector<std::string> names;
+	for (auto I(0); I < numColumns; ++I)
+		names.emplace_back(sqlite3_column_name(statement, I));
+	std::vector<const char*> values(numColumns);
+	std::vector<unsigned long> lengths(numColumns);
+
+	auto written(exportFile.Begin(std::move(names)));
+	auto result(written ? sqlite3_step(statement) : SQLITE_DONE);
+	for (; result == SQLITE_ROW && !localState.IsAbandoned(); result = sqlite3_step(statement)) {
+		for (auto I(0); I < numColumns; ++I) {
+			if (sqlite3_column_type(statement, I) == SQLITE_NULL)
+				values[I] = nullptr;
+			else {
+				values[I] = reinterpret_cast<const char*>(sqlite3_column_text(statement, I));
+				lengths[I] = static_cast<unsigned long>(sqlite3_column_bytes(statement, I));
+			}
+		}
+		if (!(written = exportFile.WriteRow(values.data(), lengths.data())))
+			break;
+	}
+	written = exportFile.End() && written;
+
+	if (!written) {
+		localState.error = exportFile.GetError();
+		localState.errnum = -1;
+		return SQLITE_DONE;
+	}
+	if (result == SQLITE_ROW)
+		//abandoned
+		return SQLITE_DONE;
+	if (result == SQLITE_DONE)
+		localState.results.Push(exportFile.Summary());
+	return result;
+}
+
+//what sqlite3_prepare_v2 left unparsed, which would otherwise be quietly skipped
+static bool HasMoreStatements(const char* tail) {
+	for (; tail && *tail; ++tail)
+		if (!std::isspace(static_cast<unsigned char>(*tail)) && *tail != ';')
+			return true;
+	return false;
+}
+
+//sqlite3_stmt_readonly says yes to these, but a transaction opened on a reader would never cover the writes that go to the writer
+static bool IsTransactionControl(const char* queryText) {
+	while (std::isspace(static_cast<unsigned char>(*queryText)))
+		++queryText;
+	static const char* const keywords[] = { "BEGIN", "COMMIT", "END", "ROLLBACK", "SAVEPOINT", "RELEASE" };
+	for (const auto I : keywords) {
+		const auto length(std::strlen(I));
+		if (sqlite3_strnicmp(queryText, I, static_cast<int>(length)) == 0 && !std::isalnum(static_cast<unsigned char>(queryText[length])) && queryText[length] != '_')
+			return true;
+	}
+	return false;
+}
+
+void SqliteQueryOperation::StartQuery(sqlite3* localReader, std::string localQueryText, const std::string localPath, const unsigned int localTimeout, std::shared_ptr<SqliteConnection::Writer> localWriter, std::shared_ptr<std::atomic_uint_fast32_t> localThreadCounter, Dispatcher& localDispatcher, std::shared_ptr<SqliteResultState> localState, std::shared_ptr<std::atomic_bool> localExited) {
+	const ExitGuard exitGuard(localExited);
+	std::unique_lock<std::mutex> writeLock(localWriter->lock, std::defer_lock);
+	sqlite3* db(nullptr);
+	sqlite3_stmt* statement(nullptr);
+	const char* tail(nullptr);
+	auto result(SQLITE_OK);
+
+	//try it on a reader first, only statements that actually write need to queue up for the writer
+	if (localWriter->wal) {
+		if (!localReader) {
+			result = SqliteConnection::OpenHandle(localPath, true, localTimeout, localReader);
+			if (result != SQLITE_OK) {
+				Finish(localReader, result, nullptr, *localThreadCounter, localDispatcher, *localState);
+				sqlite3_close_v2(localReader);
+				return;
+			}
+		}
+		db = localReader;
+		result = sqlite3_prepare_v2(db, localQueryText.c_str(), static_cast<int>(localQueryText.length()), &statement, &tail);
+		if (result == SQLITE_OK && statement && (!sqlite3_stmt_readonly(statement) || IsTransactionControl(localQueryText.c_str()))) {
+			sqlite3_finalize(statement);
+			statement = nullptr;
+			db = nullptr;
+		}
+	}
+
+	if (!db) {
+		writeLock.lock();
+		db = localWriter->handle;
+		result = sqlite3_prepare_v2(db, localQueryText.c_str(), static_cast<int>(localQueryText.length()), &statement, &tail);
+	}
+
+	if (result != SQLITE_OK || !statement) {
+		//null statement means there was only whitespace or comments
+		Finish(db, result, localReader, *localThreadCounter, localDispatcher, *localState);
+		return;
+	}
+
+	//same as MariaDB, which isn't asked for multiple statements
+	if (HasMoreStatements(tail)) {
+		sqlite3_finalize(statement);
+		localState->error = "Only one statement is allowed per query!";
+		localState->errnum = SQLITE_ERROR;
+		Finish(db, SQLITE_OK, localReader, *localThreadCounter, localDispatcher, *localState);
+		return;
+	}
+
+	const auto numColumns(sqlite3_column_count(statement));
+	//statements without a result set run as usual and never create the file
+	if (localState->exportFile && numColumns > 0) {
+		try {
+			result = ExportRows(statement, *localState->exportFile, *localState);
+		}
+		catch (std::bad_alloc&) {
+			result = SQLITE_NOMEM;
+		}
+		sqlite3_finalize(statement);
+		Finish(result == SQLITE_NOMEM ? nullptr : db, result, localReader, *localThreadCounter, localDispatcher, *localState);
+		return;
+	}
+
+	//both are per handle and left over from whatever ran last, only report what this statement changed
+	const auto totalChanges(sqlite3_total_changes(db));
+	const auto lastRowId(sqlite3_last_insert_rowid(db));
+	for (result = sqlite3_step(statement); result == SQLITE_ROW; result = sqlite3_step(statement)) {
+		try {
+			std::string json("{");
+			for (auto I(0); I < numColumns; ++I) {
+				if (I > 0)
+					json.append(",");
+				json.append("\"");
+				json.append(Library::EscapeJsonString(sqlite3_column_name(statement, I)));
+				json.append("\":");
+				if (sqlite3_column_type(statement, I) == SQLITE_NULL)
+					json.append("null");
+				else
+					//everything is text to match the mysql format
+					AppendValue(json, reinterpret_cast<const char*>(sqlite3_column_text(statement, I)), static_cast<size_t>(sqlite3_column_bytes(statement, I)), *localState);
+			}
+			json.append("}");
+
+			if (localState->IsAbandoned())
+				break;
+			localState->results.Push(std::move(json));
+		}
+		catch (std::bad_alloc&) {
+			sqlite3_finalize(statement);
+			Finish(nullptr, SQLITE_NOMEM, localReader, *localThreadCounter, localDispatcher, *localState);
+			return;
+		}
+	}
+
+	if (result == SQLITE_ROW)
+		//abandoned
+		result = SQLITE_DONE;
+	else if (result == SQLITE_DONE && sqlite3_total_changes(db) != totalChanges) {
+		localState->affectedRows = static_cast<unsigned long long>(sqlite3_changes(db));
+		if (sqlite3_last_insert_rowid(db) != lastRowId)
+			localState->insertId = static_cast<unsigned long long>(sqlite3_last_insert_rowid(db));
+	}
+	sqlite3_finalize(statement);
+	Finish(db, result, localReader, *localThreadCounter, localDispatcher, *localState);
+}
+
+bool SqliteQueryOperation::IsComplete(bool noSkip) {
+	const auto wasComplete(complete);
+	const auto result(Query::IsComplete(noSkip));
+	if (complete && !wasComplete && started) {
+		//readers we start with are already ours, take any the worker opened so they go back to the pool
+		reader = static_cast<SqliteResultState&>(*state).openedReader;
+		RecordDigest();
+	}
+	return result;
+}
+
+std::thread* SqliteQueryOperation::GetActiveThread() {
+	if (!started)
+		return nullptr;
+
+	if (!state->Abandon()) {
+		operationThread.join();
+		if (!complete)
+			reader = static_cast<SqliteResultState&>(*state).openedReader;
+		return nullptr;
+	}
+
+	//the worker is still using the reader and closes it itself
+	reader = nullptr;
+	return &operationThread;
+}
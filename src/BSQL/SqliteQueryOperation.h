@@ -0,0 +1,32 @@
+#pragma once
+
+class SqliteQueryOperation : public Query {
+private:
+	struct SqliteResultState : public ResultState {
+		//a reader the worker had to open itself, only valid to read after seeing Complete
+		sqlite3* openedReader = nullptr;
+	};
+private:
+	std::string queryText;
+	const std::string path;
+	SqliteConnection& connPool;
+	std::shared_ptr<SqliteConnection::Writer> writer;
+	sqlite3* reader;
+	const std::shared_ptr<std::atomic_uint_fast32_t> threadCounter;
+	ConcurrencyLimit& threadLimit;
+	const unsigned int timeout;
+	Dispatcher& dispatcher;
+	std::thread operationThread;
+private:
+	//these run on the worker and can't touch the operation, it may be gone
+	static void Finish(sqlite3* db, const int result, sqlite3* localReader, std::atomic_uint_fast32_t& localThreadCounter, Dispatcher& localDispatcher, SqliteResultState& localState);
+	static int ExportRows(sqlite3_stmt* statement, ExportFile& exportFile, ResultState& localState);
+	static void StartQuery(sqlite3* localReader, std::string localQueryText, const std::string localPath, const unsigned int localTimeout, std::shared_ptr<SqliteConnection::Writer> localWriter, std::shared_ptr<std::atomic_uint_fast32_t> localThreadCounter, Dispatcher& localDispatcher, std::shared_ptr<SqliteResultState> localState, std::shared_ptr<std::atomic_bool> localExited);
+public:
+	SqliteQueryOperation(SqliteConnection& connPool, std::string&& queryText, std::unique_ptr<ExportFile>&& exportFile, const bool chunked, const std::string& path, const std::shared_ptr<SqliteConnection::Writer>& writer, const unsigned int timeout, const std::shared_ptr<std::atomic_uint_fast32_t>& threadCounter, ConcurrencyLimit& threadLimit, Dispatcher& dispatcher);
+	~SqliteQueryOperation() override;
+
+	bool TryStart() override;
+	bool IsComplete(bool noSkip) override;
+	std::thread* GetActiveThread() override;
+};
@@ -0,0 +1,65 @@
+#include "BSQL.h"
+
+//one JSON object per line, "t" is milliseconds since the capture started. Credentials are never written
+TrafficRecorder::TrafficRecorder(const std::string& path) :
+	output(path, std::ios::out | std::ios::trunc | std::ios::binary),
+	startTime(std::chrono::steady_clock::now())
+{}
+
+TrafficRecorder::~TrafficRecorder() {
+	output.flush();
+}
+
+bool TrafficRecorder::Good() {
+	std::lock_guard<std::mutex> guard(lock);
+	return output.good();
+}
+
+void TrafficRecorder::WriteEntry(const char* const call, const std::string& connectionIdentifier, const std::string& fields) {
+	const auto elapsed(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count());
+	std::string line("{\"t\":");
+	line.append(std::to_string(elapsed));
+	line.append(",\"call\":\"");
+	line.append(call);
+	line.append("\",\"conn\":\"");
+	line.append(Library::EscapeJsonString(connectionIdentifier));
+	line.append("\"");
+	line.append(fields);
+	line.append("}\n");
+
+	std::lock_guard<std::mutex> guard(lock);
+	output.write(line.c_str(), line.length());
+}
+
+void TrafficRecorder::RecordCreateConnection(const std::string& connectionIdentifier, const std::string& connectionType, const unsigned int asyncTimeout, const unsigned int blockingTimeout, const unsigned int threadLimit) {
+	WriteEntry("CreateConnection", connectionIdentifier, ",\"type\":\"" + Library::EscapeJsonString(connectionType)
+		+ "\",\"asyncTimeout\":" + std::to_string(asyncTimeout)
+		+ ",\"blockingTimeout\":" + std::to_string(blockingTimeout)
+		+ ",\"threadLimit\":" + std::to_string(threadLimit));
+}
+
+void TrafficRecorder::RecordReleaseConnection(const std::string& connectionIdentifier) {
+	WriteEntry("ReleaseConnection", connectionIdentifier, std::string());
+	//connections going away is a good time to make sure everything hit the disk
+	std::lock_guard<std::mutex> guard(lock);
+	output.flush();
+}
+
+void TrafficRecorder::RecordOpenConnection(const std::string& connectionIdentifier, const std::string& operationIdentifier, const std::string& address, const unsigned short port, const std::string& database, const std::string& options) {
+	WriteEntry("OpenConnection", connectionIdentifier, ",\"op\":\"" + Library::EscapeJsonString(operationIdentifier)
+		+ "\",\"address\":\"" + Library::EscapeJsonString(address)
+		+ "\",\"port\":" + std::to_string(port)
+		+ ",\"database\":\"" + Library::EscapeJsonString(database)
+		+ "\",\"options\":\"" + Library::EscapeJsonString(options) + "\"");
+}
+
+//exports are recorded without their path, replays run them as plain queries
+void TrafficRecorder::RecordNewQuery(const std::string& connectionIdentifier, const std::string& operationIdentifier, const std::string& queryText, const unsigned int priority, const unsigned int flags, const std::string& exportFormat) {
+	WriteEntry("NewQuery", connectionIdentifier, ",\"op\":\"" + Library::EscapeJsonString(operationIdentifier)
+		+ "\",\"query\":\"" + Library::EscapeJsonString(queryText) + "\",\"priority\":" + std::to_string(priority) + ",\"flags\":" + std::to_string(flags)
+		+ (exportFormat.empty() ? std::string() : ",\"export\":\"" + Library::EscapeJsonString(exportFormat) + "\""));
+}
+
+void TrafficRecorder::RecordReleaseOperation(const std::string& connectionIdentifier, const std::string& operationIdentifier) {
+	WriteEntry("ReleaseOperation", connectionIdentifier, ",\"op\":\"" + Library::EscapeJsonString(operationIdentifier) + "\"");
+}
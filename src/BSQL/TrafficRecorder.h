@@ -0,0 +1,23 @@
+#pragma once
+
+class TrafficRecorder {
+private:
+	std::mutex lock;
+	std::ofstream output;
+	const std::chrono::steady_clock::time_point startTime;
+private:
+	void WriteEntry(const char* const call, const std::string& connectionIdentifier, const std::string& fields);
+public:
+	TrafficRecorder(const std::string& path);
+	TrafficRecorder(const TrafficRecorder&) = delete;
+	TrafficRecorder(TrafficRecorder&&) = delete;
+	~TrafficRecorder();
+
+	bool Good();
+
+	void RecordCreateConnection(const std::string& connectionIdentifier, const std::string& connectionType, const unsigned int asyncTimeout, const unsigned int blockingTimeout, const unsigned int threadLimit);
+	void RecordReleaseConnection(const std::string& connectionIdentifier);
+	void RecordOpenConnection(const std::string& connectionIdentifier, const std::string& operationIdentifier, const std::string& address, const unsigned short port, const std::string& database, const std::string& options);
+	void RecordNewQuery(const std::string& connectionIdentifier, const std::string& operationIdentifier, const std::string& queryText, const unsigned int priority, const unsigned int flags, const std::string& exportFormat);
+	void RecordReleaseOperation(const std::string& connectionIdentifier, const std::string& operationIdentifier);
+};
@@ -0,0 +1,364 @@
+//Plays back a capture made with the StartCapture export against a live server using the exported BSQL API the same way DM does
+//Usage: BSQLReplay <capture file> <host> <port> <username> <password> [database] [--speed <factor>] [--tick <ms>] [--thread-limit <n>]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+	const char* Initialize(const int argumentCount, const char* const* const args);
+	const char* Shutdown(const int argumentCount, const char* const* const args);
+	const char* CreateConnection(const int argumentCount, const char* const* const args);
+	const char* ReleaseConnection(const int argumentCount, const char* const* const args);
+	const char* OpenConnection(const int argumentCount, const char* const* const args);
+	const char* NewQuery(const int argumentCount, const char* const* const args);
+	const char* ReleaseOperation(const int argumentCount, const char* const* const args);
+	const char* BlockOnOperation(const int argumentCount, const char* const* const args);
+	const char* ReadyRow(const int argumentCount, const char* const* const args);
+	const char* NextResultSet(const int argumentCount, const char* const* const args);
+	const char* GetError(const int argumentCount, const char* const* const args);
+}
+
+typedef const char* (*ExportFunc)(const int, const char* const* const);
+typedef std::chrono::steady_clock Clock;
+
+struct Event {
+	long long time;
+	std::map<std::string, std::string> fields;
+};
+
+struct InFlight {
+	std::string connection, operation;
+	Clock::time_point issued, completed;
+	bool complete, releaseRequested;
+};
+
+//calls an export and copies the result before the library can reuse its buffer
+static bool Call(ExportFunc func, const std::vector<std::string>& args, std::string& result) {
+	std::vector<const char*> raw;
+	for (const auto& I : args)
+		raw.emplace_back(I.c_str());
+	const auto res(func(static_cast<int>(raw.size()), raw.data()));
+	if (!res)
+		return false;
+	result = res;
+	return true;
+}
+
+//creates return the new identifier, anything else is an error message
+static bool IsIdentifier(const std::string& result) {
+	return !result.empty() && std::all_of(result.begin(), result.end(), [](const char c) { return c >= '0' && c <= '9'; });
+}
+
+static bool IsRow(const std::string& result) {
+	return !result.empty() && result[0] == '{';
+}
+
+//the capture format is flat objects of string and integer values, no need for a real json parser
+static bool ParseLine(const std::string& line, Event& event) {
+	size_t pos(0);
+	const auto skipSpace([&]() {
+		while (pos < line.length() && (line[pos] == ' ' || line[pos] == '\t' || line[pos] == '\r'))
+			++pos;
+	});
+	const auto readString([&](std::string& out) {
+		if (line[pos] != '"')
+			return false;
+		for (++pos; pos < line.length() && line[pos] != '"'; ++pos) {
+			if (line[pos] != '\\') {
+				out.push_back(line[pos]);
+				continue;
+			}
+			if (++pos >= line.length())
+				return false;
+			switch (line[pos]) {
+			case 'b':
+				out.push_back('\b');
+				break;
+			case 'f':
+				out.push_back('\f');
+				break;
+			case 'n':
+				out.push_back('\n');
+				break;
+			case 'r':
+				out.push_back('\r');
+				break;
+			case 't':
+				out.push_back('\t');
+				break;
+			case 'u':
+				if (pos + 4 >= line.length())
+					return false;
+				//the recorder only emits these for control characters
+				out.push_back(static_cast<char>(std::strtol(line.substr(pos + 1, 4).c_str(), nullptr, 16)));
+				pos += 4;
+				break;
+			default:
+				out.push_back(line[pos]);
+			}
+		}
+		return pos++ < line.length();
+	});
+
+	skipSpace();
+	if (pos >= line.length() || line[pos++] != '{')
+		return false;
+	for (;;) {
+		skipSpace();
+		if (pos >= line.length())
+			return false;
+		if (line[pos] == '}')
+			break;
+		std::string key, value;
+		if (!readString(key))
+			return false;
+		skipSpace();
+		if (pos >= line.length() || line[pos++] != ':')
+			return false;
+		skipSpace();
+		if (pos >= line.length())
+			return false;
+		if (line[pos] == '"') {
+			if (!readString(value))
+				return false;
+		}
+		else
+			for (; pos < line.length() && line[pos] != ',' && line[pos] != '}'; ++pos)
+				value.push_back(line[pos]);
+		event.fields.emplace(std::move(key), std::move(value));
+		skipSpace();
+		if (pos < line.length() && line[pos] == ',')
+			++pos;
+	}
+
+	auto timeEntry(event.fields.find("t"));
+	if (timeEntry == event.fields.end() || event.fields.find("call") == event.fields.end() || event.fields.find("conn") == event.fields.end())
+		return false;
+	event.time = std::atoll(timeEntry->second.c_str());
+	return true;
+}
+
+static double Percentile(const std::vector<double>& sorted, const double percentile) {
+	if (sorted.empty())
+		return 0;
+	const auto index(static_cast<size_t>(percentile * (sorted.size() - 1)));
+	return sorted[index];
+}
+
+int main(int argc, char** argv) {
+	std::vector<std::string> positional;
+	double speed(1);
+	long long tickMs(50);
+	std::string threadLimitOverride;
+	for (auto I(1); I < argc; ++I) {
+		std::string arg(argv[I]);
+		if (arg == "--speed" && I + 1 < argc)
+			speed = std::atof(argv[++I]);
+		else if (arg == "--tick" && I + 1 < argc)
+			tickMs = std::atoll(argv[++I]);
+		else if (arg == "--thread-limit" && I + 1 < argc)
+			threadLimitOverride = argv[++I];
+		else
+			positional.emplace_back(std::move(arg));
+	}
+
+	if (positional.size() < 5 || speed <= 0 || tickMs < 0) {
+		std::fprintf(stderr, "Usage: %s <capture file> <host> <port> <username> <password> [database] [--speed <factor>] [--tick <ms>] [--thread-limit <n>]\n", argv[0]);
+		return 2;
+	}
+
+	const auto& host(positional[1]), port(positional[2]), username(positional[3]), password(positional[4]);
+	const std::string databaseOverride(positional.size() > 5 ? positional[5] : std::string());
+
+	std::vector<Event> events;
+	{
+		std::ifstream input(positional[0], std::ios::in | std::ios::binary);
+		if (!input) {
+			std::fprintf(stderr, "Unable to open %s\n", positional[0].c_str());
+			return 1;
+		}
+		std::string line;
+		for (auto lineNumber(1U); std::getline(input, line); ++lineNumber) {
+			if (line.empty())
+				continue;
+			Event event;
+			if (!ParseLine(line, event)) {
+				std::fprintf(stderr, "Malformed capture entry on line %u\n", lineNumber);
+				return 1;
+			}
+			events.emplace_back(std::move(event));
+		}
+	}
+
+	std::string result;
+	if (Call(Initialize, {}, result)) {
+		std::fprintf(stderr, "Initialize failed: %s\n", result.c_str());
+		return 1;
+	}
+
+	std::map<std::string, std::string> connections;
+	std::map<std::string, InFlight> operations;
+	std::vector<double> latencies;
+	unsigned long long errors(0), rows(0), issued(0);
+	size_t maxInFlight(0);
+	double maxIssueLag(0);
+
+	//time spent blocking on connects is not part of the capture, slide the schedule forward by it
+	auto replayStart(Clock::now());
+	const auto scheduledTime([&](const long long captureTime) {
+		return replayStart + std::chrono::microseconds(static_cast<long long>(captureTime * 1000 / speed));
+	});
+	const auto milliseconds([](const Clock::duration duration) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(duration).count() / 1000.0;
+	});
+
+	const auto poll([&]() {
+		size_t active(0);
+		for (auto I(operations.begin()); I != operations.end();) {
+			auto& op(I->second);
+			while (!op.complete) {
+				if (!Call(ReadyRow, { op.connection, op.operation }, result) || result == "NOTDONE")
+					break;
+				if (IsRow(result)) {
+					++rows;
+					continue;
+				}
+				//anything else is an error, i.e. the library released it under operation_ttl, and it won't ever be done
+				const auto failed(result != "DONE");
+				if (!failed && Call(NextResultSet, { op.connection, op.operation }, result) && result == "NEXTSET")
+					continue;
+				op.complete = true;
+				op.completed = Clock::now();
+				latencies.emplace_back(milliseconds(op.completed - op.issued));
+				if (failed || (Call(GetError, { op.connection, op.operation }, result) && !result.empty()))
+					++errors;
+				break;
+			}
+			if (op.complete && op.releaseRequested) {
+				Call(ReleaseOperation, { op.connection, op.operation }, result);
+				I = operations.erase(I);
+				continue;
+			}
+			if (!op.complete)
+				++active;
+			++I;
+		}
+		maxInFlight = std::max(maxInFlight, active);
+	});
+
+	for (auto& event : events) {
+		const auto target(scheduledTime(event.time));
+		for (auto now(Clock::now()); now < target; now = Clock::now()) {
+			poll();
+			std::this_thread::sleep_until(std::min(target, now + std::chrono::milliseconds(tickMs)));
+		}
+		maxIssueLag = std::max(maxIssueLag, milliseconds(Clock::now() - target));
+
+		const auto& call(event.fields["call"]);
+		const auto& capturedConnection(event.fields["conn"]);
+		const auto operationKey(capturedConnection + "/" + event.fields["op"]);
+
+		if (call == "CreateConnection") {
+			auto threadLimit(threadLimitOverride.empty() ? event.fields["threadLimit"] : threadLimitOverride);
+			if (!Call(CreateConnection, { event.fields["type"], event.fields["asyncTimeout"], event.fields["blockingTimeout"], threadLimit }, result) || !IsIdentifier(result)) {
+				std::fprintf(stderr, "CreateConnection failed: %s\n", result.c_str());
+				continue;
+			}
+			connections[capturedConnection] = result;
+		}
+		else if (call == "OpenConnection") {
+			auto connection(connections.find(capturedConnection));
+			if (connection == connections.end())
+				continue;
+			const auto blockStart(Clock::now());
+			const auto database(databaseOverride.empty() ? event.fields["database"] : databaseOverride);
+			std::string operation;
+			if (!Call(OpenConnection, { connection->second, host, port, username, password, database, event.fields["options"] }, operation) || !IsIdentifier(operation)) {
+				std::fprintf(stderr, "OpenConnection failed: %s\n", operation.c_str());
+				continue;
+			}
+			if (Call(BlockOnOperation, { connection->second, operation }, result))
+				std::fprintf(stderr, "Connect wait failed: %s\n", result.c_str());
+			else if (Call(GetError, { connection->second, operation }, result) && !result.empty())
+				std::fprintf(stderr, "Connect failed: %s\n", result.c_str());
+			Call(ReleaseOperation, { connection->second, operation }, result);
+			replayStart += Clock::now() - blockStart;
+		}
+		else if (call == "NewQuery") {
+			auto connection(connections.find(capturedConnection));
+			if (connection == connections.end())
+				continue;
+			//captures from before priorities were recorded ran everything as normal
+			auto priority(event.fields.find("priority") != event.fields.end() ? event.fields["priority"] : std::string("1"));
+			auto flags(event.fields.find("flags") != event.fields.end() ? event.fields["flags"] : std::string("0"));
+			//exports are marked with an "export" field but run as plain queries here, a replay never writes files
+			if (!Call(NewQuery, { connection->second, event.fields["query"], priority, flags }, result) || !IsIdentifier(result)) {
+				std::fprintf(stderr, "NewQuery failed: %s\n", result.c_str());
+				++errors;
+				continue;
+			}
+			InFlight op;
+			op.connection = connection->second;
+			op.operation = result;
+			op.complete = false;
+			op.releaseRequested = false;
+			op.issued = Clock::now();
+			operations[operationKey] = std::move(op);
+			++issued;
+		}
+		else if (call == "ReleaseOperation") {
+			//ops are held at least until they finish so slower replays still measure every query
+			auto op(operations.find(operationKey));
+			if (op != operations.end())
+				op->second.releaseRequested = true;
+		}
+		else if (call == "ReleaseConnection") {
+			auto connection(connections.find(capturedConnection));
+			if (connection == connections.end())
+				continue;
+			const auto prefix(capturedConnection + "/");
+			for (auto I(operations.begin()); I != operations.end(); ++I)
+				if (I->first.compare(0, prefix.length(), prefix) == 0)
+					I->second.releaseRequested = true;
+			for (; std::any_of(operations.begin(), operations.end(), [&](const std::pair<const std::string, InFlight>& op) { return op.first.compare(0, prefix.length(), prefix) == 0; }); std::this_thread::sleep_for(std::chrono::milliseconds(tickMs)))
+				poll();
+			Call(ReleaseConnection, { connection->second }, result);
+			connections.erase(connection);
+		}
+	}
+
+	for (auto& I : operations)
+		I.second.releaseRequested = true;
+	for (; !operations.empty(); std::this_thread::sleep_for(std::chrono::milliseconds(tickMs)))
+		poll();
+	const auto elapsed(milliseconds(Clock::now() - replayStart));
+
+	for (auto& I : connections)
+		Call(ReleaseConnection, { I.second }, result);
+	Call(Shutdown, {}, result);
+
+	std::sort(latencies.begin(), latencies.end());
+	double total(0);
+	for (auto I : latencies)
+		total += I;
+
+	std::printf("Replayed %llu queries in %.1f ms at %.2fx (tick %lld ms)\n", issued, elapsed, speed, tickMs);
+	std::printf("Throughput: %.1f queries/s, %.1f rows/s\n", elapsed > 0 ? issued * 1000 / elapsed : 0, elapsed > 0 ? rows * 1000 / elapsed : 0);
+	std::printf("Errors: %llu, max in flight: %zu, max issue lag: %.1f ms\n", errors, maxInFlight, maxIssueLag);
+	std::printf("Latency ms: min %.1f avg %.1f p50 %.1f p95 %.1f p99 %.1f max %.1f\n",
+		latencies.empty() ? 0 : latencies.front(),
+		latencies.empty() ? 0 : total / latencies.size(),
+		Percentile(latencies, 0.5),
+		Percentile(latencies, 0.95),
+		Percentile(latencies, 0.99),
+		latencies.empty() ? 0 : latencies.back());
+	return 0;
+}